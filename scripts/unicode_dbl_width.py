@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+Generate src/termptydbl.c, the character width tables behind
+_termpty_is_dblwidth_get() in src/termptydbl.h
+
+Usage: unicode_dbl_width.py [EastAsianWidth.txt] > src/termptydbl.c
+
+EastAsianWidth.txt is at https://www.unicode.org/Public/UNIDATA/
+Without it the tables come from the Unicode data shipped with python.
+
+Every codepoint gets one of 4 classes, 2 bits each:
+  0 narrow (N, Na, H), 1 wide (W, F), 2 ambiguous (A), 3 zero width
+Zero width is nonspacing and enclosing marks, format characters and
+hangul medial vowels and final consonants.
+Codepoints are split in pages of 256. Identical pages are stored once and
+a first table maps each page to the one holding its classes.
+"""
+
+import sys
+import unicodedata
+
+MAX = 0x110000
+PAGE = 256
+
+NARROW, WIDE, AMBIGUOUS, ZERO = 0, 1, 2, 3
+
+# unassigned codepoints in these ranges default to wide, see the header
+# of EastAsianWidth.txt
+DEFAULT_WIDE = ((0x3400, 0x4dbf), (0x4e00, 0x9fff), (0xf900, 0xfaff),
+                (0x20000, 0x2fffd), (0x30000, 0x3fffd))
+
+
+def eaw_from_file(path):
+    eaw = ['N'] * MAX
+    for lo, hi in DEFAULT_WIDE:
+        for g in range(lo, hi + 1):
+            eaw[g] = 'W'
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            cps, width = [s.strip() for s in line.split(';')]
+            if '..' in cps:
+                lo, hi = [int(s, 16) for s in cps.split('..')]
+            else:
+                lo = hi = int(cps, 16)
+            for g in range(lo, hi + 1):
+                eaw[g] = width
+    return eaw
+
+
+def eaw_from_python():
+    eaw = [unicodedata.east_asian_width(chr(g)) for g in range(MAX)]
+    for lo, hi in DEFAULT_WIDE:
+        for g in range(lo, hi + 1):
+            if unicodedata.category(chr(g)) == 'Cn':
+                eaw[g] = 'W'
+    return eaw
+
+
+def classify(g, width):
+    if width in ('W', 'F'):
+        return WIDE
+    if g == 0xad:
+        # soft hyphen is shown
+        return AMBIGUOUS
+    if ((unicodedata.category(chr(g)) in ('Mn', 'Me', 'Cf')) or
+            (0x1160 <= g <= 0x11ff)):
+        return ZERO
+    if width == 'A':
+        return AMBIGUOUS
+    return NARROW
+
+
+def main():
+    if len(sys.argv) > 1:
+        eaw = eaw_from_file(sys.argv[1])
+        source = sys.argv[1].rsplit('/', 1)[-1]
+    else:
+        eaw = eaw_from_python()
+        source = 'python unicodedata'
+    classes = [classify(g, eaw[g]) for g in range(MAX)]
+
+    pages = []
+    index = []
+    seen = {}
+    for p in range(0, MAX, PAGE):
+        packed = bytearray(PAGE // 4)
+        for i in range(PAGE):
+            packed[i >> 2] |= classes[p + i] << ((i & 3) * 2)
+        packed = bytes(packed)
+        if packed not in seen:
+            seen[packed] = len(pages)
+            pages.append(packed)
+        index.append(seen[packed])
+    assert len(pages) <= 256
+
+    out = sys.stdout
+    out.write('/* generated by scripts/unicode_dbl_width.py from %s\n'
+              ' * (unicode %s), do not edit */\n'
+              % (source, unicodedata.unidata_version))
+    out.write('#include "private.h"\n\n'
+              '#include <Elementary.h>\n'
+              '#include "termpty.h"\n'
+              '#include "termptydbl.h"\n\n')
+    out.write('const unsigned char _termpty_width_pages[%d] =\n{\n'
+              % len(index))
+    for i in range(0, len(index), 16):
+        out.write('   ' + ', '.join('%3d' % v for v in index[i:i + 16]) +
+                  ',\n')
+    out.write('};\n\n')
+    out.write('const unsigned char _termpty_width_classes[%d] =\n{\n'
+              % (len(pages) * PAGE // 4))
+    for n, page in enumerate(pages):
+        out.write('   // %d\n' % n)
+        for i in range(0, len(page), 16):
+            out.write('   ' + ', '.join('0x%02x' % v for v in page[i:i + 16]) +
+                      ',\n')
+    out.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -10,7 +10,7 @@
 #include "col.h"
 #include "utils.h"
 
-#define CONF_VER 4
+#define CONF_VER 6
 
 #define LIM(v, min, max) {if (v >= max) v = max; else if (v <= min) v = min;}
 
@@ -103,6 +103,16 @@ config_init(void)
      (edd_base, Config, "background", background, EET_T_STRING);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "scrollback", scrollback, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "scrollback_budget", scrollback_budget, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "scrollback_spill", scrollback_spill, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "search_index", search_index, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "search_index_budget", search_index_budget, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "word_separators", word_separators, EET_T_STRING);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "tab_zoom", tab_zoom, EET_T_DOUBLE);
    EET_DATA_DESCRIPTOR_ADD_BASIC
@@ -119,6 +129,8 @@ config_init(void)
      (edd_base, Config, "disable_visual_bell", disable_visual_bell, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "active_links", active_links, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "highlight_links", highlight_links, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "translucent", translucent, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
@@ -232,6 +244,12 @@ config_sync(const Config *config_src, Config *config)
    eina_stringshare_replace(&(config->helper.local.image), config_src->helper.local.image);
    eina_stringshare_replace(&(config->theme), config_src->theme);
    config->scrollback = config_src->scrollback;
+   config->scrollback_budget = config_src->scrollback_budget;
+   config->scrollback_spill = config_src->scrollback_spill;
+   config->search_index = config_src->search_index;
+   config->search_index_budget = config_src->search_index_budget;
+   eina_stringshare_replace(&(config->word_separators),
+                            config_src->word_separators);
    config->tab_zoom = config_src->tab_zoom;
    config->vidmod = config_src->vidmod;
    config->jump_on_keypress = config_src->jump_on_keypress;
@@ -241,6 +259,7 @@ config_sync(const Config *config_src, Config *config)
    config->disable_visual_bell = config_src->disable_visual_bell;
    config->bell_rings = config_src->bell_rings;
    config->active_links = config_src->active_links;
+   config->highlight_links = config_src->highlight_links;
    config->mute = config_src->mute;
    config->visualize = config_src->visualize;
    config->urg_bell = config_src->urg_bell;
@@ -462,7 +481,15 @@ config_load(const char *key)
                     }
                   config->gravatar = EINA_TRUE;
                   /*pass through*/
-                case CONF_VER: /* 4 */
+                case 4:
+                  config->scrollback_budget = 16;
+                  config->scrollback_spill = EINA_FALSE;
+                  /*pass through*/
+                case 5:
+                  config->search_index = EINA_FALSE;
+                  config->search_index_budget = 32;
+                  /*pass through*/
+                case CONF_VER: /* 6 */
                   config->version = CONF_VER;
                   break;
                 default:
@@ -497,6 +524,10 @@ config_load(const char *key)
              config->helper.local.image = eina_stringshare_add("xdg-open");
              config->helper.inline_please = EINA_TRUE;
              config->scrollback = 2000;
+             config->scrollback_budget = 16;
+             config->search_index = EINA_FALSE;
+             config->search_index_budget = 32;
+             config->word_separators = NULL;
              config->theme = eina_stringshare_add("default.edj");
              config->background = NULL;
              config->tab_zoom = 0.5;
@@ -511,6 +542,7 @@ config_load(const char *key)
              config->disable_visual_bell = EINA_FALSE;
              config->bell_rings = EINA_TRUE;
              config->active_links = EINA_TRUE;
+             config->highlight_links = EINA_FALSE;
              config->translucent = EINA_FALSE;
              config->mute = EINA_FALSE;
              config->visualize = EINA_TRUE;
@@ -584,6 +616,11 @@ config_fork(Config *config)
    SCPY(theme);
    SCPY(background);
    CPY(scrollback);
+   CPY(scrollback_budget);
+   CPY(scrollback_spill);
+   CPY(search_index);
+   CPY(search_index_budget);
+   SCPY(word_separators);
    CPY(tab_zoom);
    CPY(vidmod);
    CPY(jump_on_change);
@@ -593,6 +630,7 @@ config_fork(Config *config)
    CPY(disable_visual_bell);
    CPY(bell_rings);
    CPY(active_links);
+   CPY(highlight_links);
    CPY(translucent);
    CPY(opacity);
    CPY(mute);
@@ -642,6 +680,7 @@ config_del(Config *config)
    eina_stringshare_del(config->font.orig_name);
    eina_stringshare_del(config->theme);
    eina_stringshare_del(config->background);
+   eina_stringshare_del(config->word_separators);
    eina_stringshare_del(config->helper.email);
    eina_stringshare_del(config->helper.url.general);
    eina_stringshare_del(config->helper.url.video);
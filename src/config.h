@@ -27,6 +27,11 @@ struct _Config
 {
    int               version;
    int               scrollback;
+   int               scrollback_budget; /* in MB for all terminals, 0 = no limit */
+   Eina_Bool         scrollback_spill;
+   Eina_Bool         search_index;
+   int               search_index_budget; /* in MB for all terminals, 0 = no limit */
+   const char       *word_separators; /* utf8, NULL for the built in ones */
    struct {
       const char    *name;
       const char    *orig_name; /* not in EET */
@@ -58,6 +63,7 @@ struct _Config
    Eina_Bool         disable_visual_bell;
    Eina_Bool         bell_rings;
    Eina_Bool         active_links;
+   Eina_Bool         highlight_links;
    Eina_Bool         translucent;
    Eina_Bool         mute;
    Eina_Bool         visualize;
@@ -448,6 +448,27 @@ cb_miniview(Evas_Object *term)
    return EINA_TRUE;
 }
 
+static Eina_Bool
+cb_scrollback_stats(Evas_Object *term)
+{
+   termio_stats_toggle(term);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+cb_search_next(Evas_Object *term)
+{
+   termio_search_next(term, EINA_TRUE);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+cb_search_prev(Evas_Object *term)
+{
+   termio_search_next(term, EINA_FALSE);
+   return EINA_TRUE;
+}
+
 static Eina_Bool
 cb_increase_font_size(Evas_Object *term)
 {
@@ -567,6 +588,12 @@ static Shortcut_Action _actions[] =
      {"group", gettext_noop("Actions"), NULL},
      {"miniview", gettext_noop("Display the history miniview"), cb_miniview},
      {"cmd_box", gettext_noop("Display the command box"), cb_cmd_box},
+     {"scrollback_stats", gettext_noop("Display scrollback memory statistics"),
+      cb_scrollback_stats},
+     {"search_next", gettext_noop("Jump to the next older search match"),
+      cb_search_next},
+     {"search_prev", gettext_noop("Jump to the next newer search match"),
+      cb_search_prev},
 
      {NULL, NULL, NULL}
 };
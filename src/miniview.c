@@ -67,51 +67,65 @@ struct _Miniview
 
 static Evas_Smart *_smart = NULL;
 
-static void
-_draw_cell(const Termpty *ty, unsigned int *pixel, const Termcell *cell, unsigned int *colors)
+/* color of cells with these attributes. when *fg_only is set the color
+ * only shows for printable codepoints, otherwise for any non-empty cell */
+static unsigned int
+_att_pixel(const Termpty *ty, const Termatt *att, unsigned int *colors,
+           Eina_Bool *fg_only)
 {
-   int fg, bg, fgext, bgext;
+   int fg, bg, fgext, bgext, fgrgb, bgrgb;
    int inv = ty->state.reverse;
-   Eina_Unicode codepoint;
 
-   codepoint = cell->codepoint;
-   if ((codepoint == 0) || (cell->att.newline) || (cell->att.invisible))
-     {
-        *pixel = 0;
-        return;
-     }
+   *fg_only = EINA_FALSE;
+   if ((att->newline) || (att->invisible)) return 0;
    // colors
-   fg = cell->att.fg;
-   bg = cell->att.bg;
-   fgext = cell->att.fg256;
-   bgext = cell->att.bg256;
-
-   if ((fg == COL_DEF) && (cell->att.inverse ^ inv)) fg = COL_INVERSEBG;
+   fg = att->fg;
+   bg = att->bg;
+   fgext = att->fg256;
+   bgext = att->bg256;
+   fgrgb = att->fgrgb;
+   bgrgb = att->bgrgb;
+
+   if (fgrgb) fg += TERMPTY_RGB_BASE;
+   if (bgrgb) bg += TERMPTY_RGB_BASE;
+   if ((fg == COL_DEF) && (att->inverse ^ inv)) fg = COL_INVERSEBG;
    if (bg == COL_DEF)
      {
-        if (cell->att.inverse ^ inv) bg = COL_INVERSE;
+        if (att->inverse ^ inv) bg = COL_INVERSE;
         else if (!bgext) bg = COL_INVIS;
      }
-   if ((cell->att.fgintense) && (!fgext)) fg += 48;
-   if ((cell->att.bgintense) && (!bgext)) bg += 48;
-   if (cell->att.inverse ^ inv)
+   if ((att->fgintense) && (!fgext) && (!fgrgb)) fg += 48;
+   if ((att->bgintense) && (!bgext) && (!bgrgb)) bg += 48;
+   if (att->inverse ^ inv)
      {
         int t;
         t = fgext; fgext = bgext; bgext = t;
+        t = fgrgb; fgrgb = bgrgb; bgrgb = t;
         t = fg; fg = bg; bg = t;
      }
-   if ((cell->att.bold) && (!fgext)) fg += 12;
-   if ((cell->att.faint) && (!fgext)) fg += 24;
-   
-   if (bgext) *pixel = colors[bg + 256];
-   else if (bg && ((bg % 12) != COL_INVIS)) *pixel = colors[bg];
-   else if ((codepoint > 32) && (codepoint < 0x00110000))
-     {
-        if (fgext) *pixel = colors[fg + 256];
-        else *pixel = colors[fg];
-     }
-   else
+   if ((att->bold) && (!fgext) && (!fgrgb)) fg += 12;
+   if ((att->faint) && (!fgext) && (!fgrgb)) fg += 24;
+
+   if (bgext) return colors[bg + 256];
+   else if ((bgrgb) || (bg && ((bg % 12) != COL_INVIS))) return colors[bg];
+   *fg_only = EINA_TRUE;
+   if (fgext) return colors[fg + 256];
+   return colors[fg];
+}
+
+static void
+_draw_cell(const Termpty *ty, unsigned int *pixel, const Termcell *cell, unsigned int *colors)
+{
+   Eina_Unicode codepoint = cell->codepoint;
+   Eina_Bool fg_only;
+   unsigned int pix;
+
+   pix = _att_pixel(ty, &(cell->att), colors, &fg_only);
+   if ((codepoint == 0) ||
+       ((fg_only) && ((codepoint <= 32) || (codepoint >= 0x00110000))))
      *pixel = 0;
+   else
+     *pixel = pix;
 }
 
 static void
@@ -126,6 +140,33 @@ _draw_line(const Termpty *ty, unsigned int *pixels,
      }
 }
 
+/* same as _draw_line() but works out colors once per attribute in the row
+ * instead of once per cell */
+static void
+_draw_row(const Termpty *ty, unsigned int *pixels,
+          const Termrow *row, int length, unsigned int *colors)
+{
+   unsigned int pix[256];
+   Eina_Bool fg_only[256];
+   const Eina_Unicode *cp = row->codepoints;
+   const unsigned char *idx = row->idx;
+   int x;
+
+   for (x = 0; x < row->npal; x++)
+     pix[x] = _att_pixel(ty, &(row->pal[x].att), colors, &(fg_only[x]));
+   for (x = 0; x < length; x++)
+     {
+        Eina_Unicode codepoint = cp[x];
+        int i = idx[x];
+
+        if ((codepoint == 0) ||
+            ((fg_only[i]) && ((codepoint <= 32) || (codepoint >= 0x00110000))))
+          pixels[x] = 0;
+        else
+          pixels[x] = pix[i];
+     }
+}
+
 Eina_Bool
 _is_top_bottom_reached(Miniview *mv)
 {
@@ -494,11 +535,13 @@ _deferred_renderer(void *data)
    int history_len, wret, pos;
    unsigned int *pixels, y;
    Termcell *cells;
+   Termrow row;
    Termpty *ty;
    unsigned int colors[512];
    double bottom_bound;
 
    if (!mv) return EINA_FALSE;
+   memset(&row, 0, sizeof(row));
 
    if ((!mv->is_shown) || (!mv->to_render) || (mv->img_h == 0))
      {
@@ -530,10 +573,21 @@ _deferred_renderer(void *data)
 
    for (y = 0; y < mv->img_h; y++)
      {
+        // views leave compressed history as it is
+        if (termpty_row_view_get(ty, mv->img_hist + y, &row))
+          {
+             wret = row.w;
+             if (wret > (int)mv->cols) wret = mv->cols;
+             _draw_row(ty, &pixels[y * mv->cols], &row, wret, colors);
+             continue;
+          }
         cells = termpty_cellrow_get(ty, mv->img_hist + y, &wret);
         if (!cells) break;
+        // rows still waiting for a rewrap can be wider than the image
+        if (wret > (int)mv->cols) wret = mv->cols;
         _draw_line(ty, &pixels[y * mv->cols], cells, wret, colors);
      }
+   termpty_row_view_free(&row);
    evas_object_image_data_set(mv->img, pixels);
    evas_object_image_pixels_dirty_set(mv->img, EINA_FALSE);
    evas_object_image_data_update_add(mv->img, 0, 0, ow, oh);
@@ -9,7 +9,7 @@
 #include "options_behavior.h"
 #include "main.h"
 
-static Evas_Object *op_w, *op_h;
+static Evas_Object *op_w, *op_h, *op_sback;
 
 #define CB(_cfg_name, _inv)                                     \
 static void                                                     \
@@ -35,6 +35,7 @@ CB(bell_rings, 0);
 CB(flicker_on_key, 0);
 CB(urg_bell, 0);
 CB(active_links, 0);
+CB(highlight_links, 0);
 CB(multi_instance, 0);
 CB(xterm_256color, 0);
 CB(erase_is_del, 0);
@@ -43,6 +44,7 @@ CB(login_shell, 0);
 CB(mouse_over_focus, 0);
 CB(gravatar,  0);
 CB(notabs,  1);
+CB(search_index, 0);
 
 #undef CB
 
@@ -51,8 +53,8 @@ sback_double_to_expo_int(double d)
 {
     if (d < 1.0)
         return 0;
-    if (d >= 17.0)
-        d = 17.0;
+    if (d >= 21.0)
+        d = 21.0;
     return 1 << (unsigned char) d;
 }
 
@@ -78,6 +80,79 @@ _cb_op_behavior_sback_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
    config_save(config, NULL);
 }
 
+static void
+_cb_op_behavior_scrollback_spill(void *data, Evas_Object *obj,
+                                 void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+   double max;
+
+   config->scrollback_spill = elm_check_state_get(obj);
+   /* lines past 2^17 are only allowed with a spill file */
+   max = config->scrollback_spill ? 21.0 : 17.0;
+   if (config->scrollback > (double)(1 << (int)max))
+     config->scrollback = (double)(1 << (int)max);
+   if (op_sback)
+     {
+        elm_slider_min_max_set(op_sback, 0.0, max);
+        if (elm_slider_value_get(op_sback) > max)
+          elm_slider_value_set(op_sback, max);
+     }
+   termio_config_update(term);
+   windows_update();
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_sback_budget_chg(void *data, Evas_Object *obj,
+                                 void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->scrollback_budget = (int)round(elm_slider_value_get(obj));
+   termio_config_update(term);
+   windows_update();
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_search_index_budget_chg(void *data, Evas_Object *obj,
+                                        void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->search_index_budget = (int)round(elm_slider_value_get(obj));
+   termio_config_update(term);
+   windows_update();
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_word_separators_chg(void *data, Evas_Object *obj,
+                                    void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+   char *txt;
+
+   if (config->word_separators)
+     {
+        eina_stringshare_del(config->word_separators);
+        config->word_separators = NULL;
+     }
+   txt = elm_entry_markup_to_utf8(elm_object_text_get(obj));
+   if (txt)
+     {
+        if (txt[0]) config->word_separators = eina_stringshare_add(txt);
+        free(txt);
+     }
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
 static void
 _cb_op_behavior_tab_zoom_slider_chg(void *data, Evas_Object *obj,
                                     void *event EINA_UNUSED)
@@ -183,6 +258,7 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    CX(_("Bell rings"), bell_rings, 0);
    CX(_("Urgent Bell"), urg_bell, 0);
    CX(_("Active Links"), active_links, 0);
+   CX(_("Underline all links on screen"), highlight_links, 0);
    CX(_("Multiple instances, one process"), multi_instance, 0);
    CX(_("Set TERM to xterm-256color"), xterm_256color, 0);
    CX(_("BackArrow sends Del (instead of BackSpace)"), erase_is_del, 0);
@@ -191,9 +267,39 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    CX(_("Focus split under the Mouse"), mouse_over_focus, 0);
    CX(_("Gravatar integration"), gravatar, 0);
    CX(_("Show tabs"), notabs, 1);
+   CX(_("Keep old scrollback in a temporary file"), scrollback_spill, 0);
+   CX(_("Index scrollback for fast search"), search_index, 0);
 
 #undef CX
 
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, _("Word separators (empty for the defaults):"));
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_entry_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
+   elm_entry_single_line_set(o, EINA_TRUE);
+   elm_entry_scrollable_set(o, EINA_TRUE);
+   elm_scroller_policy_set(o, ELM_SCROLLER_POLICY_OFF, ELM_SCROLLER_POLICY_OFF);
+   if (config->word_separators)
+     {
+        char *txt = elm_entry_utf8_to_markup(config->word_separators);
+
+        if (txt)
+          {
+             elm_object_text_set(o, txt);
+             free(txt);
+          }
+     }
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "changed",
+                                  _cb_op_behavior_word_separators_chg, term);
+
 
    o = elm_check_add(bx);
    evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
@@ -259,7 +365,7 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    elm_box_pack_end(bx, o);
    evas_object_show(o);
 
-   o = elm_slider_add(bx);
+   op_sback = o = elm_slider_add(bx);
    evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
    evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
    elm_slider_span_size_set(o, 40);
@@ -279,13 +385,72 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    } u;
    u.v = config->scrollback;
    u.c = (u.c >> 23) - 127;
-   elm_slider_min_max_set(o, 0.0, 17.0);
+   /* lines past 2^17 are only allowed with a spill file */
+   elm_slider_min_max_set(o, 0.0, config->scrollback_spill ? 21.0 : 17.0);
    elm_slider_value_set(o, u.c);
    elm_box_pack_end(bx, o);
    evas_object_show(o);
    evas_object_smart_callback_add(o, "delay,changed",
                                   _cb_op_behavior_sback_chg, term);
 
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, _("Scrollback memory (all terminals):"));
+   tooltip = _("Oldest lines of the busiest terminals<br>"
+       "are dropped once all scrollback together<br>"
+       "uses more than this. 0 means no limit");
+   elm_object_tooltip_text_set(o, tooltip);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   elm_object_tooltip_text_set(o, tooltip);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+   elm_slider_step_set(o, 1.0 / 256.0);
+#endif
+   elm_slider_unit_format_set(o, _("%1.0f MB"));
+   elm_slider_indicator_format_set(o, _("%1.0f MB"));
+   elm_slider_min_max_set(o, 0.0, 256.0);
+   elm_slider_value_set(o, config->scrollback_budget);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_sback_budget_chg, term);
+
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, _("Search index memory (all terminals):"));
+   tooltip = _("Oldest lines of the biggest indexes<br>"
+       "are searched the slow way once all<br>"
+       "indexes together use more than this.<br>"
+       "0 means no limit");
+   elm_object_tooltip_text_set(o, tooltip);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   elm_object_tooltip_text_set(o, tooltip);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+   elm_slider_step_set(o, 1.0 / 256.0);
+#endif
+   elm_slider_unit_format_set(o, _("%1.0f MB"));
+   elm_slider_indicator_format_set(o, _("%1.0f MB"));
+   elm_slider_min_max_set(o, 0.0, 256.0);
+   elm_slider_value_set(o, config->search_index_budget);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_search_index_budget_chg,
+                                  term);
+
    o = elm_label_add(bx);
    evas_object_size_hint_weight_set(o, 0.0, 0.0);
    evas_object_size_hint_align_set(o, 0.0, 0.5);
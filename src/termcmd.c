@@ -4,20 +4,97 @@
 #include "main.h"
 #include "win.h"
 #include "termio.h"
+#include "termptylog.h"
 #include "config.h"
 #include "controls.h"
 #include "utils.h"
 #include "termcmd.h"
 
 static Eina_Bool
-_termcmd_search(Evas_Object *obj EINA_UNUSED, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd)
+_termcmd_search(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd)
 {
    if (cmd[0] == 0) // clear search
      {
-        printf("search clear\n");
+        termio_search_set(obj, NULL, EINA_FALSE);
         return EINA_TRUE;
      }
-   printf("search '%s'\n", cmd);
+   termio_search_set(obj, cmd, EINA_FALSE);
+   return EINA_TRUE;
+}
+
+/* search every terminal of the window, fast with search_index set */
+static Eina_Bool
+_termcmd_search_all(Evas_Object *obj, Evas_Object *win, Evas_Object *bg EINA_UNUSED, const char *cmd)
+{
+   Eina_List *l;
+   Term *term;
+
+   if (!win)
+     {
+        termio_search_set(obj, cmd[0] ? cmd : NULL, EINA_FALSE);
+        return EINA_TRUE;
+     }
+   EINA_LIST_FOREACH(terms_from_win_object(win), l, term)
+     termio_search_set(main_term_evas_object_get(term),
+                       cmd[0] ? cmd : NULL, EINA_FALSE);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_termcmd_search_regex(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd)
+{
+   if (cmd[0] == 0) // clear search
+     {
+        termio_search_set(obj, NULL, EINA_TRUE);
+        return EINA_TRUE;
+     }
+   termio_search_set(obj, cmd, EINA_TRUE);
+   return EINA_TRUE;
+}
+
+/* the file name cmd starts with, a leading ~/ stands for the home dir */
+static const char *
+_termcmd_path_get(const char *cmd, char *buf, size_t size)
+{
+   const char *home = getenv("HOME");
+
+   while (*cmd == ' ') cmd++;
+   if ((cmd[0] == '~') && (cmd[1] == '/') && (home))
+     {
+        snprintf(buf, size, "%s%s", home, cmd + 1);
+        return buf;
+     }
+   return cmd;
+}
+
+/* e writes history and screen to a file as text, E with the colors and
+ * attributes as escapes */
+static Eina_Bool
+_termcmd_export(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd, Eina_Bool sgr)
+{
+   char buf[PATH_MAX];
+
+   cmd = _termcmd_path_get(cmd, buf, sizeof(buf));
+   if (cmd[0] == 0)
+     {
+        ERR(_("Export needs a file name"));
+        return EINA_TRUE;
+     }
+   termio_export(obj, cmd, sgr);
+   return EINA_TRUE;
+}
+
+/* l appends all output from now on to a file, L as an lz4 frame. with no
+ * file name logging stops */
+static Eina_Bool
+_termcmd_log(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd, Eina_Bool lz4)
+{
+   Termpty *ty = termio_pty_get(obj);
+   char buf[PATH_MAX];
+
+   if (!ty) return EINA_TRUE;
+   cmd = _termcmd_path_get(cmd, buf, sizeof(buf));
+   termpty_log_set(ty, cmd[0] ? cmd : NULL, lz4);
    return EINA_TRUE;
 }
 
@@ -126,6 +203,8 @@ termcmd_watch(Evas_Object *obj, Evas_Object *win, Evas_Object *bg, const char *c
    if (!cmd) return EINA_FALSE;
    if ((cmd[0] == '/') || (cmd[0] == 's'))
      return _termcmd_search(obj, win, bg, cmd + 1);
+   if (cmd[0] == 'r')
+     return _termcmd_search_regex(obj, win, bg, cmd + 1);
    return EINA_FALSE;
 }
 
@@ -136,6 +215,14 @@ termcmd_do(Evas_Object *obj, Evas_Object *win, Evas_Object *bg, const char *cmd)
    if (!cmd || !cmd[0]) return EINA_FALSE;
    if ((cmd[0] == '/') || (cmd[0] == 's'))
      return _termcmd_search(obj, win, bg, cmd + 1);
+   if (cmd[0] == 'r')
+     return _termcmd_search_regex(obj, win, bg, cmd + 1);
+   if (cmd[0] == 'S')
+     return _termcmd_search_all(obj, win, bg, cmd + 1);
+   if ((cmd[0] == 'e') || (cmd[0] == 'E'))
+     return _termcmd_export(obj, win, bg, cmd + 1, cmd[0] == 'E');
+   if ((cmd[0] == 'l') || (cmd[0] == 'L'))
+     return _termcmd_log(obj, win, bg, cmd + 1, cmd[0] == 'L');
    if ((cmd[0] == 'f') || (cmd[0] == 'F'))
      return _termcmd_font_size(obj, win, bg, cmd + 1);
    if ((cmd[0] == 'g') || (cmd[0] == 'G'))
@@ -9,7 +9,13 @@
 
 #include "termio.h"
 #include "termiolink.h"
+#include "termiosearch.h"
+#include "termioexport.h"
+#include "termiowordsep.h"
 #include "termpty.h"
+#include "termptysave.h"
+#include "termptyindex.h"
+#include "termptylog.h"
 #include "termcmd.h"
 #include "termptydbl.h"
 #include "utf8.h"
@@ -25,6 +31,12 @@
 # include <libproc.h>
 #endif
 
+/* selections of more rows than this are put together in idle time, in
+ * slices of this many seconds checked every so many rows */
+#define SELECTION_SYNC_ROWS 1000
+#define SELECTION_SLICE 0.004
+#define SELECTION_SLICE_ROWS 64
+
 typedef struct _Termio Termio;
 
 struct _Termio
@@ -64,22 +76,43 @@ struct _Termio
          unsigned char dndobjdel : 1;
       } down;
    } link;
+   Termlinks *links; /* every link on screen, if highlight_links is set */
+   Termsearch *search;
+   Termexport *export; /* history being written to a file, if any */
    int zoom_fontsize_start;
+   double zoom; /* scale the grid is shown at while pinching, 0 if none */
    int scroll;
    Evas_Object *self;
    Evas_Object *event;
    Term *term;
 
    Termpty *pty;
+   int rgb_num; /* 24bit colors of the pty already in the grid palette */
+   unsigned int rgb_gen; /* of the pty color table they came from */
    Ecore_Animator *anim;
    Ecore_Timer *delayed_size_timer;
    Ecore_Timer *link_do_timer;
    Ecore_Timer *mouse_selection_scroll_timer;
    Ecore_Job *mouse_move_job;
    Ecore_Timer *mouseover_delay;
+   struct {
+      Evas_Object *obj;
+      Ecore_Timer *timer;
+   } stats;
    Evas_Object *win, *theme, *glayer;
    Config *config;
-   const char *sel_str;
+   char *sel_str; /* what we put in the clipboard */
+   size_t sel_len;
+   /* text of a big selection being put together in idle time, rows are
+    * counted from backsaved in Termpty so they can scroll meanwhile */
+   struct {
+      Ecore_Idler *idler;
+      Eina_Strbuf *sb;
+      long long row, row1, row2;
+      int c1x, c2x;
+      unsigned int backgen;
+      Elm_Sel_Type type;
+   } selget;
    const char *preedit_str;
    Eina_List *cur_chids;
    Ecore_Job *sel_reset_job;
@@ -95,6 +128,7 @@ struct _Termio
    unsigned char bottom_right : 1;
    unsigned char top_left : 1;
    unsigned char reset_sel : 1;
+   unsigned char size_defer : 1;
 };
 
 #define INT_SWAP(_a, _b) do {    \
@@ -110,10 +144,11 @@ static Eina_List *terms = NULL;
 static void _sel_set(Termio *sd, Eina_Bool enable);
 static void _remove_links(Termio *sd, Evas_Object *obj);
 static void _smart_update_queue(Evas_Object *obj, Termio *sd);
+static Eina_Bool _smart_cb_delayed_size(void *data);
 static void _smart_apply(Evas_Object *obj);
 static void _smart_size(Evas_Object *obj, int w, int h, Eina_Bool force);
 static void _smart_calculate(Evas_Object *obj);
-static void _take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text);
+static void _take_selection_text(Evas_Object *obj, Elm_Sel_Type type, char *text, size_t len);
 
 
 /* {{{ Helpers */
@@ -435,6 +470,226 @@ termio_term_get(Evas_Object *obj)
    return sd->term;
 }
 
+static void
+_stats_text_update(Termio *sd)
+{
+   Termsave_Stats st, all;
+   Termindex_Stats ist;
+   char buf[1024];
+   double ratio = 0.0;
+   int n;
+
+   termpty_save_stats_get(sd->pty, &st);
+   termpty_save_stats_get(NULL, &all);
+   termpty_index_stats_get(sd->pty, &ist);
+   if (st.bytes_comp > 0)
+     ratio = (double)st.bytes_cells / (double)st.bytes_comp;
+   n = snprintf(buf, sizeof(buf),
+                "rows: %i raw, %i lz4, %i cold, %i spilled<br>"
+                "%i shared, %i blank<br>"
+                "this pty: %llu KiB resident, %llu KiB on disk, ratio %1.2f<br>"
+                "all: %llu / %llu KiB allocated, %llu KiB mapped, %i blocks<br>"
+                "reclaimed %llu KiB, compressor %1.3fs in %i runs",
+                st.rows_raw, st.rows_comp, st.rows_cold, st.rows_spilled,
+                st.rows_shared, st.rows_blank,
+                (unsigned long long)st.bytes_resident / 1024,
+                (unsigned long long)st.bytes_spilled / 1024, ratio,
+                (unsigned long long)all.bytes_allocated / 1024,
+                (unsigned long long)all.bytes_budget / 1024,
+                (unsigned long long)all.bytes_mapped / 1024, all.blocks,
+                (unsigned long long)all.bytes_reclaimed / 1024,
+                all.comp_time, all.comp_runs);
+   if ((termpty_index_get(sd->pty)) && (n > 0) && (n < (int)sizeof(buf)))
+     snprintf(buf + n, sizeof(buf) - n,
+              "<br>index: %i rows%s, %i trigrams, %llu entries, %llu KiB<br>"
+              "all indexes: %llu / %llu KiB",
+              ist.rows, ist.building ? " (building)" : "", ist.grams,
+              (unsigned long long)ist.postings,
+              (unsigned long long)ist.bytes / 1024,
+              (unsigned long long)ist.bytes_all / 1024,
+              (unsigned long long)ist.bytes_budget / 1024);
+   n = strlen(buf);
+   if (sd->export)
+     snprintf(buf + n, sizeof(buf) - n, "<br>export: %i%%",
+              (int)(termio_export_progress_get(sd->export) * 100.0));
+   n = strlen(buf);
+   if ((termpty_log_path_get(sd->pty)) && (n < (int)sizeof(buf)))
+     {
+        char *path = evas_textblock_text_utf8_to_markup
+          (NULL, termpty_log_path_get(sd->pty));
+
+        snprintf(buf + n, sizeof(buf) - n, "<br>log: %s", path ? path : "");
+        free(path);
+     }
+   evas_object_textblock_text_markup_set(sd->stats.obj, buf);
+}
+
+static Eina_Bool
+_stats_cb_timer(void *data)
+{
+   Termio *sd = data;
+
+   _stats_text_update(sd);
+   return ECORE_CALLBACK_RENEW;
+}
+
+void
+termio_size_defer_set(Evas_Object *obj, Eina_Bool defer)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   if (sd->size_defer == !!defer) return;
+   sd->size_defer = !!defer;
+   if (sd->delayed_size_timer) ecore_timer_del(sd->delayed_size_timer);
+   sd->delayed_size_timer =
+     ecore_timer_add(defer ? 0.25 : 0.0, _smart_cb_delayed_size, obj);
+}
+
+void
+termio_stats_toggle(Evas_Object *obj)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   Evas_Textblock_Style *ts;
+   Evas_Coord ox, oy;
+   Evas_Object *o;
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   if (sd->stats.obj)
+     {
+        ecore_timer_del(sd->stats.timer);
+        evas_object_del(sd->stats.obj);
+        sd->stats.timer = NULL;
+        sd->stats.obj = NULL;
+        return;
+     }
+   o = evas_object_textblock_add(evas_object_evas_get(obj));
+   ts = evas_textblock_style_new();
+   evas_textblock_style_set(ts, "DEFAULT='font=Mono font_size=10 "
+                            "color=#fff style=outline "
+                            "outline_color=#000a wrap=none'");
+   evas_object_textblock_style_set(o, ts);
+   evas_textblock_style_free(ts);
+   evas_object_pass_events_set(o, EINA_TRUE);
+   evas_object_propagate_events_set(o, EINA_FALSE);
+   evas_object_smart_member_add(o, obj);
+   sd->stats.obj = o;
+   _stats_text_update(sd);
+   evas_object_geometry_get(obj, &ox, &oy, NULL, NULL);
+   evas_object_move(o, ox, oy);
+   evas_object_resize(o, sd->grid.w * sd->font.chw,
+                      sd->grid.h * sd->font.chh);
+   evas_object_show(o);
+   sd->stats.timer = ecore_timer_add(0.5, _stats_cb_timer, sd);
+}
+
+/* show the selected match, in the middle of the screen if it is off it */
+static void
+_search_show(Evas_Object *obj, Termio *sd, int y)
+{
+   int scroll;
+
+   if (((y + sd->scroll) >= 0) && ((y + sd->scroll) < sd->grid.h))
+     {
+        _smart_update_queue(obj, sd);
+        return;
+     }
+   scroll = (sd->grid.h / 2) - y;
+   if (scroll > sd->pty->backscroll_num) scroll = sd->pty->backscroll_num;
+   if (scroll < 0) scroll = 0;
+   termio_scroll_set(obj, scroll);
+}
+
+static void
+_search_cb_found(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   // while typing go to the first match found
+   if (!termio_search_selected_get(sd->search, NULL))
+     termio_search_next(obj, EINA_TRUE);
+   else
+     _smart_update_queue(obj, sd);
+}
+
+void
+termio_search_set(Evas_Object *obj, const char *str, Eina_Bool regex)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   if ((sd->search) && (str) &&
+       (termio_search_regex_get(sd->search) == !!regex) &&
+       (!strcmp(termio_search_string_get(sd->search), str)))
+     return;
+   termio_search_free(sd->search);
+   sd->search = NULL;
+   if ((str) && (str[0]))
+     {
+        sd->search = termio_search_new(sd->pty, str, regex,
+                                       _search_cb_found, obj);
+        if (sd->search) termio_search_next(obj, EINA_TRUE);
+     }
+   _smart_update_queue(obj, sd);
+}
+
+/* select the next match up the history if older, else down */
+void
+termio_search_next(Evas_Object *obj, Eina_Bool older)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   int y;
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   if (!sd->search) return;
+   if (termio_search_select(sd->search, older,
+                            older ? (sd->grid.h - 1 - sd->scroll) : -sd->scroll,
+                            &y))
+     _search_show(obj, sd, y);
+}
+
+static void
+_export_cb(void *data, Termexport *ex)
+{
+   Termio *sd = data;
+
+   switch (termio_export_state_get(ex))
+     {
+      case TERMIO_EXPORT_RUNNING:
+         DBG("export %s: %i%%", termio_export_path_get(ex),
+             (int)(termio_export_progress_get(ex) * 100.0));
+         return;
+      case TERMIO_EXPORT_DONE:
+         INF("exported history to %s", termio_export_path_get(ex));
+         break;
+      case TERMIO_EXPORT_FAILED:
+         break;
+     }
+   if (sd->export == ex) sd->export = NULL;
+   termio_export_free(ex);
+}
+
+/* write history and screen to a file, any export still going is stopped */
+void
+termio_export(Evas_Object *obj, const char *path, Eina_Bool sgr)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   termio_export_free(sd->export);
+   sd->export = termio_export_new(sd->pty, path, sgr, _export_cb, sd);
+}
+
+static int
+_scrollback_lines_get(const Config *config)
+{
+   if (config->scrollback_spill)
+     return MIN(config->scrollback, TERMPTY_SAVE_BACK_SPILL_MAX);
+   return MIN(config->scrollback, TERMPTY_SAVE_BACK_MAX);
+}
+
 static void
 _font_size_set(Evas_Object *obj, int size)
 {
@@ -586,7 +841,14 @@ termio_config_update(Evas_Object *obj)
 	   sd->jump_on_change = sd->config->jump_on_change;
 	   sd->jump_on_keypress = sd->config->jump_on_keypress;
 
-	   termpty_backscroll_set(sd->pty, sd->config->scrollback);
+	   termpty_backscroll_set(sd->pty, _scrollback_lines_get(sd->config));
+	   termpty_save_spill_set(sd->pty, sd->config->scrollback_spill);
+	   termpty_save_budget_set((uint64_t)sd->config->scrollback_budget *
+	                           1024 * 1024);
+	   termpty_index_budget_set((uint64_t)sd->config->search_index_budget *
+	                            1024 * 1024);
+	   termio_wordsep_set(sd->config->word_separators);
+	   termpty_index_set(sd->pty, sd->config->search_index);
    }
    sd->scroll = 0;
 
@@ -718,8 +980,12 @@ _activate_link(Evas_Object *obj, Eina_Bool may_inline)
    if (link_is_url(sd->link.string))
      {
         if (casestartswith(sd->link.string, "file://"))
-          // TODO: decode string: %XX -> char
-          path = sd->link.string + sizeof("file://") - 1;
+          {
+             // TODO: decode string: %XX -> char
+             path = sd->link.string + sizeof("file://") - 1;
+             // explicit links have the host in, file://host/path
+             if (path[0] != '/') path = strchr(path, '/');
+          }
         else
           url = EINA_TRUE;
      }
@@ -822,7 +1088,8 @@ _cb_ctxp_link_copy(void *data, Evas_Object *obj, void *event EINA_UNUSED)
    Termio *sd = evas_object_smart_data_get(term);
    EINA_SAFETY_ON_NULL_RETURN(sd);
    EINA_SAFETY_ON_NULL_RETURN(sd->link.string);
-   _take_selection_text(term, ELM_SEL_TYPE_CLIPBOARD, sd->link.string);
+   _take_selection_text(term, ELM_SEL_TYPE_CLIPBOARD, strdup(sd->link.string),
+                        strlen(sd->link.string));
    evas_object_del(obj);
 }
 
@@ -1732,106 +1999,115 @@ end:
 /* }}} */
 /* {{{ Selection */
 
-char *
-termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
-                     size_t *len)
+/* append the text in row y of the selection from c1x,c1y to c2x,c2y,
+ * built in one go on the stack and added to sb at once */
+static void
+_selection_row_get(Termio *sd, Eina_Strbuf *sb, int y,
+                   int c1x, int c1y, int c2x, int c2y)
 {
-   Termio *sd = evas_object_smart_data_get(obj);
-   Eina_Strbuf *sb;
-   char *s;
-   int x, y;
-   size_t len_backup;
+   Termcell *cells;
+   char *txt, *p;
+   int x, w = 0, last0 = -1, v, start_x, end_x;
 
-   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, NULL);
-   sb = eina_strbuf_new();
-   termpty_cellcomp_freeze(sd->pty);
-   for (y = c1y; y <= c2y; y++)
+   cells = termpty_cellrow_get(sd->pty, y, &w);
+   if (!cells) return;
+   if (w > sd->grid.w) w = sd->grid.w;
+   if (y == c1y && c1x >= w)
      {
-        Termcell *cells;
-        int w, last0, v, start_x, end_x;
-
-        w = 0;
-        last0 = -1;
-        cells = termpty_cellrow_get(sd->pty, y, &w);
-        if (!cells) continue;
-        if (w > sd->grid.w) w = sd->grid.w;
-        if (y == c1y && c1x >= w)
+        eina_strbuf_append_char(sb, '\n');
+        return;
+     }
+   start_x = c1x;
+   end_x = (c2x >= w) ? w - 1 : c2x;
+   if (c1y != c2y)
+     {
+        if (y == c1y) end_x = w - 1;
+        else if (y == c2y) start_x = 0;
+        else
           {
-             eina_strbuf_append_char(sb, '\n');
-             continue;
+             start_x = 0;
+             end_x = w - 1;
           }
-        start_x = c1x;
-        end_x = (c2x >= w) ? w - 1 : c2x;
-        if (c1y != c2y)
+     }
+   // a cell gives at most 6 bytes, blanks before a char one each
+   p = txt = alloca((w * 6) + 8);
+   for (x = start_x; x <= end_x; x++)
+     {
+#if defined(SUPPORT_DBLWIDTH)
+        if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth))
           {
-             if (y == c1y) end_x = w - 1;
-             else if (y == c2y) start_x = 0;
-             else
-               {
-                  start_x = 0;
-                  end_x = w - 1;
-               }
+             if (x < end_x) x++;
+             else break;
           }
-        for (x = start_x; x <= end_x; x++)
-          {
-#if defined(SUPPORT_DBLWIDTH)
-             if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth))
-               {
-                  if (x < end_x) x++;
-                  else break;
-               }
 #endif
-             if (x >= w) break;
-             if (cells[x].codepoint == 0)
-               {
-                  if (last0 < 0) last0 = x;
-               }
-             else if (cells[x].att.newline)
+        if (x >= w) break;
+        if (cells[x].codepoint == 0)
+          {
+             if (last0 < 0) last0 = x;
+          }
+        else if (cells[x].att.newline)
+          {
+             last0 = -1;
+             if ((y != c2y) || (x != end_x))
+               *p++ = '\n';
+             break;
+          }
+        else if (cells[x].att.tab)
+          {
+             *p++ = '\t';
+             x = ((x + 8) / 8) * 8;
+             x--;
+          }
+        else
+          {
+             Eina_Unicode g = cells[x].codepoint;
+
+             if (last0 >= 0)
                {
+                  v = x - last0;
                   last0 = -1;
-                  if ((y != c2y) || (x != end_x))
-                    eina_strbuf_append_char(sb, '\n');
-                  break;
+                  memset(p, ' ', v);
+                  p += v;
                }
-             else if (cells[x].att.tab)
+             if (g < 0x80) *p++ = g;
+             else p += codepoint_to_utf8(g, p);
+             if ((x == (w - 1)) &&
+                 ((x != c2x) || (y != c2y)))
                {
-                  eina_strbuf_append_char(sb, '\t');
-                  x = ((x + 8) / 8) * 8;
-                  x--;
+                  if (!cells[x].att.autowrapped)
+                    *p++ = '\n';
                }
-             else
-               {
-                  char txt[8];
-                  int txtlen;
+          }
+     }
+   if (last0 >= 0)
+     {
+        if (y == c2y)
+          {
+             Eina_Bool have_more = EINA_FALSE;
 
-                  if (last0 >= 0)
+             for (x = end_x + 1; x < w; x++)
+               {
+#if defined(SUPPORT_DBLWIDTH)
+                  if ((cells[x].codepoint == 0) &&
+                      (cells[x].att.dblwidth))
                     {
-                       v = x - last0 - 1;
-                       last0 = -1;
-                       while (v >= 0)
-                         {
-                            eina_strbuf_append_char(sb, ' ');
-                            v--;
-                         }
+                       if (x < (w - 1)) x++;
+                       else break;
                     }
-                  txtlen = codepoint_to_utf8(cells[x].codepoint, txt);
-                  if (txtlen > 0)
-                    eina_strbuf_append_length(sb, txt, txtlen);
-                  if ((x == (w - 1)) &&
-                      ((x != c2x) || (y != c2y)))
+#endif
+                  if (((cells[x].codepoint != 0) &&
+                       (cells[x].codepoint != ' ')) ||
+                      (cells[x].att.newline) ||
+                      (cells[x].att.tab))
                     {
-                       if (!cells[x].att.autowrapped)
-                         eina_strbuf_append_char(sb, '\n');
+                       have_more = EINA_TRUE;
+                       break;
                     }
                }
-          }
-        if (last0 >= 0)
-          {
-             if (y == c2y)
+             if (!have_more) *p++ = '\n';
+             else
                {
-                  Eina_Bool have_more = EINA_FALSE;
-
-                  for (x = end_x + 1; x < w; x++)
+                  for (x = last0; x <= end_x; x++)
                     {
 #if defined(SUPPORT_DBLWIDTH)
                        if ((cells[x].codepoint == 0) &&
@@ -1841,36 +2117,31 @@ termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
                             else break;
                          }
 #endif
-                       if (((cells[x].codepoint != 0) &&
-                            (cells[x].codepoint != ' ')) ||
-                           (cells[x].att.newline) ||
-                           (cells[x].att.tab))
-                         {
-                            have_more = EINA_TRUE;
-                            break;
-                         }
-                    }
-                  if (!have_more) eina_strbuf_append_char(sb, '\n');
-                  else
-                    {
-                       for (x = last0; x <= end_x; x++)
-                         {
-#if defined(SUPPORT_DBLWIDTH)
-                            if ((cells[x].codepoint == 0) &&
-                                (cells[x].att.dblwidth))
-                              {
-                                 if (x < (w - 1)) x++;
-                                 else break;
-                              }
-#endif
-                            if (x >= w) break;
-                            eina_strbuf_append_char(sb, ' ');
-                         }
+                       if (x >= w) break;
+                       *p++ = ' ';
                     }
                }
-             else eina_strbuf_append_char(sb, '\n');
           }
+        else *p++ = '\n';
      }
+   if (p > txt) eina_strbuf_append_length(sb, txt, p - txt);
+}
+
+char *
+termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
+                     size_t *len)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   Eina_Strbuf *sb;
+   char *s;
+   int y;
+   size_t len_backup;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, NULL);
+   sb = eina_strbuf_new();
+   termpty_cellcomp_freeze(sd->pty);
+   for (y = c1y; y <= c2y; y++)
+     _selection_row_get(sd, sb, y, c1x, c1y, c2x, c2y);
    termpty_cellcomp_thaw(sd->pty);
 
    if (!len) len = &len_backup;
@@ -1885,7 +2156,6 @@ termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
    return s;
 }
 
-
 static void
 _sel_set(Termio *sd, Eina_Bool enable)
 {
@@ -1912,7 +2182,7 @@ _lost_selection_reset_job(void *data)
    sd->sel_reset_job = NULL;
    elm_cnp_selection_set(sd->win, sd->sel_type,
                          ELM_SEL_FORMAT_TEXT,
-                         sd->sel_str, strlen(sd->sel_str));
+                         sd->sel_str, sd->sel_len);
    elm_cnp_selection_loss_callback_set(sd->win, sd->sel_type,
                                        _lost_selection, data);
 }
@@ -1940,11 +2210,8 @@ _lost_selection(void *data, Elm_Sel_Type selection)
           }
         if (sd->have_sel)
           {
-             if (sd->sel_str)
-               {
-                  eina_stringshare_del(sd->sel_str);
-                  sd->sel_str = NULL;
-               }
+             free(sd->sel_str);
+             sd->sel_str = NULL;
              _sel_set(sd, EINA_FALSE);
              elm_object_cnp_selection_clear(sd->win, selection);
              _smart_update_queue(obj, sd);
@@ -1953,14 +2220,18 @@ _lost_selection(void *data, Elm_Sel_Type selection)
      }
 }
 
+/* hands text of len bytes, malloced, to the clipboard and keeps it */
 static void
-_take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text)
+_take_selection_text(Evas_Object *obj, Elm_Sel_Type type, char *text,
+                     size_t len)
 {
    Termio *sd = evas_object_smart_data_get(obj);
 
-   EINA_SAFETY_ON_NULL_RETURN(sd);
-
-   text = eina_stringshare_add(text);
+   if ((!sd) || (!text))
+     {
+        free(text);
+        return;
+     }
 
    sd->have_sel = EINA_FALSE;
    sd->reset_sel = EINA_FALSE;
@@ -1968,13 +2239,67 @@ _take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text)
    sd->sel_type = type;
    elm_cnp_selection_set(sd->win, type,
                          ELM_SEL_FORMAT_TEXT,
-                         text,
-                         eina_stringshare_strlen(text));
+                         text, len);
    elm_cnp_selection_loss_callback_set(sd->win, type,
                                        _lost_selection, obj);
    sd->have_sel = EINA_TRUE;
-   if (sd->sel_str) eina_stringshare_del(sd->sel_str);
+   free(sd->sel_str);
    sd->sel_str = text;
+   sd->sel_len = len;
+}
+
+static void
+_selget_cancel(Termio *sd)
+{
+   if (sd->selget.idler) ecore_idler_del(sd->selget.idler);
+   if (sd->selget.sb) eina_strbuf_free(sd->selget.sb);
+   sd->selget.idler = NULL;
+   sd->selget.sb = NULL;
+}
+
+static Eina_Bool
+_selget_cb_idle(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+   double t0 = ecore_time_get();
+   long long base;
+   size_t len;
+   char *s;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, ECORE_CALLBACK_CANCEL);
+   // history got rewrapped under us, the rows are not the selected ones
+   if (sd->selget.backgen != sd->pty->backgen)
+     {
+        sd->selget.idler = NULL;
+        _selget_cancel(sd);
+        return ECORE_CALLBACK_CANCEL;
+     }
+   base = sd->pty->backsaved;
+   termpty_cellcomp_freeze(sd->pty);
+   while (sd->selget.row <= sd->selget.row2)
+     {
+        _selection_row_get(sd, sd->selget.sb, sd->selget.row - base,
+                           sd->selget.c1x, sd->selget.row1 - base,
+                           sd->selget.c2x, sd->selget.row2 - base);
+        sd->selget.row++;
+        if (((sd->selget.row % SELECTION_SLICE_ROWS) == 0) &&
+            ((ecore_time_get() - t0) >= SELECTION_SLICE))
+          break;
+     }
+   termpty_cellcomp_thaw(sd->pty);
+   if (sd->selget.row <= sd->selget.row2) return ECORE_CALLBACK_RENEW;
+
+   sd->selget.idler = NULL;
+   len = eina_strbuf_length_get(sd->selget.sb);
+   s = eina_strbuf_string_steal(sd->selget.sb);
+   eina_strbuf_free(sd->selget.sb);
+   sd->selget.sb = NULL;
+   if ((s) && (len > 0) && (sd->win))
+     _take_selection_text(obj, sd->selget.type, s, len);
+   else
+     free(s);
+   return ECORE_CALLBACK_CANCEL;
 }
 
 void
@@ -1986,6 +2311,7 @@ termio_take_selection(Evas_Object *obj, Elm_Sel_Type type)
    size_t len = 0;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
+   _selget_cancel(sd);
    if (sd->pty->selection.is_active)
      {
         start_x = sd->pty->selection.start.x;
@@ -2028,6 +2354,20 @@ termio_take_selection(Evas_Object *obj, Elm_Sel_Type type)
         len = strlen(sd->link.string);
         s = strndup(sd->link.string, len);
      }
+   else if ((end_y - start_y) >= SELECTION_SYNC_ROWS)
+     {
+        // too much to do at once, put it together in idle time
+        sd->selget.sb = eina_strbuf_new();
+        if (!sd->selget.sb) return;
+        sd->selget.row1 = sd->selget.row = sd->pty->backsaved + start_y;
+        sd->selget.row2 = sd->pty->backsaved + end_y;
+        sd->selget.c1x = start_x;
+        sd->selget.c2x = end_x;
+        sd->selget.backgen = sd->pty->backgen;
+        sd->selget.type = type;
+        sd->selget.idler = ecore_idler_add(_selget_cb_idle, obj);
+        return;
+     }
    else if ((start_x != end_x) || (start_y != end_y))
      {
         s = termio_selection_get(obj, start_x, start_y, end_x, end_y, &len);
@@ -2036,8 +2376,9 @@ termio_take_selection(Evas_Object *obj, Elm_Sel_Type type)
    if (s)
      {
         if ((sd->win) && (len > 0))
-          _take_selection_text(obj, type, s);
-        free(s);
+          _take_selection_text(obj, type, s, len);
+        else
+          free(s);
      }
 }
 
@@ -2265,203 +2606,61 @@ end:
 }
 
 static Eina_Bool
-_codepoint_is_wordsep(const Eina_Unicode g)
-{
-   /* TODO: use bitmaps to speed things up */
-   // http://en.wikipedia.org/wiki/Asterisk
-   // http://en.wikipedia.org/wiki/Comma
-   // http://en.wikipedia.org/wiki/Interpunct
-   // http://en.wikipedia.org/wiki/Bracket
-   static const Eina_Unicode wordsep[] =
-     {
-       0,
-       ' ',
-       '!',
-       '"',
-       '#',
-       '$',
-       '\'',
-       '(',
-       ')',
-       '*',
-       ',',
-       ':',
-       ';',
-       '=',
-       '?',
-       '[',
-       '\\',
-       ']',
-       '^',
-       '`',
-       '{',
-       '|',
-       '}',
-       0x00a0,
-       0x00ab,
-       0x00b7,
-       0x00bb,
-       0x0294,
-       0x02bb,
-       0x02bd,
-       0x02d0,
-       0x0312,
-       0x0313,
-       0x0314,
-       0x0315,
-       0x0326,
-       0x0387,
-       0x055d,
-       0x055e,
-       0x060c,
-       0x061f,
-       0x066d,
-       0x07fb,
-       0x1363,
-       0x1367,
-       0x14fe,
-       0x1680,
-       0x1802,
-       0x1808,
-       0x180e,
-       0x2000,
-       0x2001,
-       0x2002,
-       0x2003,
-       0x2004,
-       0x2005,
-       0x2006,
-       0x2007,
-       0x2008,
-       0x2009,
-       0x200a,
-       0x200b,
-       0x2018,
-       0x2019,
-       0x201a,
-       0x201b,
-       0x201c,
-       0x201d,
-       0x201e,
-       0x201f,
-       0x2022,
-       0x2027,
-       0x202f,
-       0x2039,
-       0x203a,
-       0x203b,
-       0x203d,
-       0x2047,
-       0x2048,
-       0x2049,
-       0x204e,
-       0x205f,
-       0x2217,
-       0x225f,
-       0x2308,
-       0x2309,
-       0x2420,
-       0x2422,
-       0x2423,
-       0x2722,
-       0x2723,
-       0x2724,
-       0x2725,
-       0x2731,
-       0x2732,
-       0x2733,
-       0x273a,
-       0x273b,
-       0x273c,
-       0x273d,
-       0x2743,
-       0x2749,
-       0x274a,
-       0x274b,
-       0x2a7b,
-       0x2a7c,
-       0x2cfa,
-       0x2e2e,
-       0x2e2e,
-       0x3000,
-       0x3001,
-       0x3008,
-       0x3009,
-       0x300a,
-       0x300b,
-       0x300c,
-       0x300c,
-       0x300d,
-       0x300d,
-       0x300e,
-       0x300f,
-       0x3010,
-       0x3011,
-       0x301d,
-       0x301e,
-       0x301f,
-       0x30fb,
-       0xa60d,
-       0xa60f,
-       0xa6f5,
-       0xfe10,
-       0xfe41,
-       0xfe42,
-       0xfe43,
-       0xfe44,
-       0xfe50,
-       0xfe51,
-       0xfe56,
-       0xfe61,
-       0xfe62,
-       0xfe63,
-       0xfeff,
-       0xff02,
-       0xff07,
-       0xff08,
-       0xff09,
-       0xff0a,
-       0xff0c,
-       0xff1b,
-       0xff1c,
-       0xff1e,
-       0xff1f,
-       0xff3b,
-       0xff3d,
-       0xff5b,
-       0xff5d,
-       0xff62,
-       0xff63,
-       0xff64,
-       0xff65,
-       0xe002a
-   };
-   size_t imax = (sizeof(wordsep) / sizeof(wordsep[0])) - 1,
-          imin = 0;
-   size_t imaxmax = imax;
-
-   if (g & 0x80000000)
-     return EINA_TRUE;
-
-   while (imax >= imin)
-     {
-        size_t imid = (imin + imax) / 2;
-
-        if (wordsep[imid] == g) return EINA_TRUE;
-        else if (wordsep[imid] < g) imin = imid + 1;
-        else imax = imid - 1;
-        if (imax > imaxmax) break;
+_sel_word_row_wrapped(const Termrow *row)
+{
+   return (row->w > 0) && (row->pal[row->idx[row->w - 1]].att.autowrapped);
+}
+
+/* index of the separator the word holding x starts after, scanning back
+ * from x, -1 if the row has none before x */
+static int
+_sel_word_row_back(const Termrow *row, int x)
+{
+   const Eina_Unicode *cp = row->codepoints;
+
+   for (; x >= 0; x--)
+     {
+#if defined(SUPPORT_DBLWIDTH)
+        if ((cp[x] == 0) && (x > 0) &&
+            (row->pal[row->idx[x]].att.dblwidth))
+          {
+             if (termio_wordsep_is(cp[x - 1])) return x;
+             x--;
+             continue;
+          }
+#endif
+        if (termio_wordsep_is(cp[x])) return x;
      }
-   return EINA_FALSE;
+   return -1;
+}
+
+/* index of the separator the word holding x ends before, w if none */
+static int
+_sel_word_row_fwd(const Termrow *row, int x)
+{
+   const Eina_Unicode *cp = row->codepoints;
+
+   for (; x < row->w; x++)
+     {
+#if defined(SUPPORT_DBLWIDTH)
+        // the right half of a wide character is a 0, which counts as a
+        // separator - step over it and go on with the cell after it
+        if ((cp[x] == 0) && (x < (row->w - 1)) &&
+            (row->pal[row->idx[x]].att.dblwidth))
+          continue;
+#endif
+        if (termio_wordsep_is(cp[x])) return x;
+     }
+   return row->w;
 }
 
 static void
 _sel_word(Termio *sd, int cx, int cy)
 {
-   Termcell *cells;
-   int x, y, w = 0;
-   Eina_Bool done = EINA_FALSE;
+   Termrow row;
+   int x, y, s;
 
+   memset(&row, 0, sizeof(row));
    termpty_cellcomp_freeze(sd->pty);
 
    _sel_set(sd, EINA_TRUE);
@@ -2472,8 +2671,6 @@ _sel_word(Termio *sd, int cx, int cy)
    sd->pty->selection.start.y = cy;
    sd->pty->selection.end.x = cx;
    sd->pty->selection.end.y = cy;
-   x = cx;
-   y = cy;
 
    if (sd->link.string &&
        (sd->link.x1 <= cx) && (cx <= sd->link.x2) &&
@@ -2485,88 +2682,48 @@ _sel_word(Termio *sd, int cx, int cy)
         sd->pty->selection.end.y = sd->link.y2;
         goto end;
      }
-   cells = termpty_cellrow_get(sd->pty, y, &w);
-   if (!cells) goto end;
-   if (x >= w) x = w - 1;
+   if (!termpty_row_view_get(sd->pty, cy, &row)) goto end;
+   x = cx;
+   if (x >= row.w) x = row.w - 1;
 
-   do
+   /* back over the row and the rows wrapping into it, a row at a time */
+   y = cy;
+   for (;;)
      {
-        for (; x >= 0; x--)
+        s = _sel_word_row_back(&row, x);
+        if (s < x)
           {
-#if defined(SUPPORT_DBLWIDTH)
-             if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth) &&
-                 (x > 0))
-               x--;
-#endif
-             if (_codepoint_is_wordsep(cells[x].codepoint))
-               {
-                  done = EINA_TRUE;
-                  break;
-               }
-             sd->pty->selection.start.x = x;
+             sd->pty->selection.start.x = s + 1;
              sd->pty->selection.start.y = y;
           }
-        if (!done)
-          {
-             Termcell *old_cells = cells;
-
-             cells = termpty_cellrow_get(sd->pty, y - 1, &w);
-             if (!cells || !cells[w-1].att.autowrapped)
-               {
-                  x = 0;
-                  cells = old_cells;
-                  done = EINA_TRUE;
-               }
-             else
-               {
-                  y--;
-                  x = w - 1;
-               }
-          }
+        if (s >= 0) break;
+        if (!termpty_row_view_get(sd->pty, y - 1, &row)) break;
+        if (!_sel_word_row_wrapped(&row)) break;
+        y--;
+        x = row.w - 1;
      }
-   while (!done);
 
-   done = EINA_FALSE;
-   if (cy != y)
-     {
-        y = cy;
-        cells = termpty_cellrow_get(sd->pty, y, &w);
-        if (!cells) goto end;
-     }
+   /* then forward from the cursor, row was left on the one above */
+   if (!termpty_row_view_get(sd->pty, cy, &row)) goto end;
    x = cx;
-
-   do
+   y = cy;
+   for (;;)
      {
-        for (; x < w; x++)
+        s = _sel_word_row_fwd(&row, x);
+        if (s > x)
           {
-#if defined(SUPPORT_DBLWIDTH)
-             if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth) &&
-                 (x < (w - 1)))
-               {
-                  sd->pty->selection.end.x = x;
-                  x++;
-               }
-#endif
-             if (_codepoint_is_wordsep(cells[x].codepoint))
-               {
-                  done = EINA_TRUE;
-                  break;
-               }
-             sd->pty->selection.end.x = x;
+             sd->pty->selection.end.x = s - 1;
              sd->pty->selection.end.y = y;
           }
-        if (!done)
-          {
-             if (!cells[w - 1].att.autowrapped) goto end;
-             y++;
-             x = 0;
-             cells = termpty_cellrow_get(sd->pty, y, &w);
-             if (!cells) goto end;
-          }
+        if (s < row.w) break;
+        if (!_sel_word_row_wrapped(&row)) break;
+        if (!termpty_row_view_get(sd->pty, y + 1, &row)) break;
+        y++;
+        x = 0;
      }
-   while (!done);
 
   end:
+   termpty_row_view_free(&row);
 
    sd->pty->selection.by_word = EINA_TRUE;
    sd->pty->selection.is_top_to_bottom = EINA_TRUE;
@@ -3108,8 +3265,12 @@ _smart_mouseover_apply(Evas_Object *obj)
         return;
      }
 
-   s = _termio_link_find(obj, sd->mouse.cx, sd->mouse.cy,
+   if (sd->links)
+     s = termio_links_at(sd->links, sd->mouse.cx, sd->mouse.cy,
                          &x1, &y1, &x2, &y2);
+   else
+     s = _termio_link_find(obj, sd->mouse.cx, sd->mouse.cy,
+                           &x1, &y1, &x2, &y2);
    if (!s)
      {
         _remove_links(sd, obj);
@@ -4061,6 +4222,52 @@ _smart_cb_gest_long_move(void *data, void *event EINA_UNUSED)
    return EVAS_EVENT_FLAG_ON_HOLD;
 }
 
+/* while pinching, the grid as it is gets scaled around the top-left
+ * corner and the font is only really changed once the gesture ends, so
+ * the pty is resized and history rewrapped a single time */
+static void
+_smart_zoom_map_apply(Termio *sd)
+{
+   Evas_Object *objs[2] = { sd->grid.obj, sd->cursor.obj };
+   Evas_Coord ox = 0, oy = 0;
+   int i;
+
+   evas_object_geometry_get(sd->self, &ox, &oy, NULL, NULL);
+   for (i = 0; i < 2; i++)
+     {
+        Evas_Map *m;
+
+        if (!objs[i]) continue;
+        if (sd->zoom <= 0.0)
+          {
+             evas_object_map_enable_set(objs[i], EINA_FALSE);
+             continue;
+          }
+        m = evas_map_new(4);
+        if (!m) continue;
+        evas_map_util_points_populate_from_object(m, objs[i]);
+        evas_map_util_zoom(m, sd->zoom, sd->zoom, ox, oy);
+        evas_object_map_set(objs[i], m);
+        evas_object_map_enable_set(objs[i], EINA_TRUE);
+        evas_map_free(m);
+     }
+}
+
+static void
+_smart_zoom_set(Termio *sd, double zoom)
+{
+   if ((zoom > 0.0) && (sd->zoom_fontsize_start > 0))
+     {
+        double min = 5.0 / sd->zoom_fontsize_start;
+        double max = 100.0 / sd->zoom_fontsize_start;
+
+        if (zoom < min) zoom = min;
+        else if (zoom > max) zoom = max;
+     }
+   sd->zoom = zoom;
+   _smart_zoom_map_apply(sd);
+}
+
 static Evas_Event_Flags
 _smart_cb_gest_zoom_start(void *data, void *event)
 {
@@ -4072,11 +4279,8 @@ _smart_cb_gest_zoom_start(void *data, void *event)
    config = sd->config;
    if (config)
      {
-        int sz;
-
         sd->zoom_fontsize_start = config->font.size;
-        sz = (double)sd->zoom_fontsize_start * p->zoom;
-        if (sz != config->font.size) _font_size_set(data, sz);
+        _smart_zoom_set(sd, p->zoom);
      }
    sd->didclick = EINA_TRUE;
    return EVAS_EVENT_FLAG_ON_HOLD;
@@ -4087,15 +4291,9 @@ _smart_cb_gest_zoom_move(void *data, void *event)
 {
    Elm_Gesture_Zoom_Info *p = event;
    Termio *sd = evas_object_smart_data_get(data);
-   Config *config;
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EVAS_EVENT_FLAG_ON_HOLD);
-   config = sd->config;
-   if (config)
-     {
-        int sz = (double)sd->zoom_fontsize_start * p->zoom;
-        if (sz != config->font.size) _font_size_set(data, sz);
-     }
+   if (sd->config) _smart_zoom_set(sd, p->zoom);
    sd->didclick = EINA_TRUE;
    return EVAS_EVENT_FLAG_ON_HOLD;
 }
@@ -4108,6 +4306,7 @@ _smart_cb_gest_zoom_end(void *data, void *event)
    Config *config;
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EVAS_EVENT_FLAG_ON_HOLD);
+   _smart_zoom_set(sd, 0.0);
    config = sd->config;
    if (config)
      {
@@ -4123,15 +4322,10 @@ _smart_cb_gest_zoom_abort(void *data, void *event EINA_UNUSED)
 {
 //   Elm_Gesture_Zoom_Info *p = event;
    Termio *sd = evas_object_smart_data_get(data);
-   Config *config;
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EVAS_EVENT_FLAG_ON_HOLD);
-   config = sd->config;
-   if (config)
-     {
-        if (sd->zoom_fontsize_start != config->font.size)
-          _font_size_set(data, sd->zoom_fontsize_start);
-     }
+   // the font was never touched, just drop the scaling
+   _smart_zoom_set(sd, 0.0);
    sd->didclick = EINA_TRUE;
    return EVAS_EVENT_FLAG_ON_HOLD;
 }
@@ -4139,6 +4333,34 @@ _smart_cb_gest_zoom_abort(void *data, void *event EINA_UNUSED)
 /* }}} */
 /* {{{ Smart */
 
+/* underline cells of row y that are now in a link, or no longer are */
+static void
+_smart_apply_links(Termio *sd, int y, Evas_Textgrid_Cell *tc,
+                   const Termcell *cells, int w,
+                   const unsigned char *was, unsigned char *now,
+                   int *ch1, int *ch2)
+{
+   int x;
+
+   termio_links_row_mask(sd->links, y, now);
+   for (x = 0; x < sd->grid.w; x++)
+     {
+        int ul;
+
+        if (was[x] == now[x]) continue;
+        if ((!cells) || (x >= w) || (tc[x].codepoint == 0)) continue;
+        ul = now[x] || cells[x].att.underline;
+        if (tc[x].underline == ul) continue;
+        tc[x].underline = ul;
+        if (*ch1 < 0) *ch1 = *ch2 = x;
+        else
+          {
+             if (x < *ch1) *ch1 = x;
+             if (x > *ch2) *ch2 = x;
+          }
+     }
+}
+
 static void
 _smart_apply(Evas_Object *obj)
 {
@@ -4147,6 +4369,8 @@ _smart_apply(Evas_Object *obj)
    Eina_List *l, *ln;
    Termblock *blk;
    int x, y, w, ch1 = 0, ch2 = 0, inv = 0, preedit_x = 0, preedit_y = 0;
+   int fix1 = 0, fix2 = -1;
+   unsigned char *lmask = NULL, *lmask2 = NULL, *smask = NULL;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
    evas_object_geometry_get(obj, &ox, &oy, &ow, &oh);
@@ -4157,17 +4381,61 @@ _smart_apply(Evas_Object *obj)
         blk->active = EINA_FALSE;
      }
    inv = sd->pty->state.reverse;
+   // palette entries for 24bit colors are only set once something uses them
+   if (sd->rgb_gen != sd->pty->rgb.gen)
+     {
+        sd->rgb_gen = sd->pty->rgb.gen;
+        sd->rgb_num = 0;
+     }
+   for (; sd->rgb_num < sd->pty->rgb.num; sd->rgb_num++)
+     {
+        unsigned int col = sd->pty->rgb.colors[sd->rgb_num];
+
+        evas_object_textgrid_palette_set
+          (sd->grid.obj, EVAS_TEXTGRID_PALETTE_STANDARD,
+           TERMPTY_RGB_BASE + sd->rgb_num,
+           (col >> 16) & 0xff, (col >> 8) & 0xff, col & 0xff, 0xff);
+     }
+   if ((sd->config->highlight_links) && (sd->config->active_links) &&
+       (sd->grid.w > 0))
+     {
+        if (!sd->links) sd->links = termio_links_new();
+        if (sd->links)
+          {
+             termio_links_frame(sd->links, sd->grid.w, sd->grid.h,
+                                sd->scroll);
+             lmask = alloca(sd->grid.w);
+             lmask2 = alloca(sd->grid.w);
+          }
+     }
+   else if (sd->links)
+     {
+        termio_links_free(sd->links);
+        sd->links = NULL;
+     }
+   if ((sd->search) && (sd->grid.w > 0))
+     {
+        termio_search_frame(sd->search);
+        smask = alloca(sd->grid.w);
+     }
    termpty_cellcomp_freeze(sd->pty);
    for (y = 0; y < sd->grid.h; y++)
      {
         Termcell *cells;
         Evas_Textgrid_Cell *tc;
+        unsigned char *sm = NULL;
 
         w = 0;
         cells = termpty_cellrow_get(sd->pty, y - sd->scroll, &w);
         tc = evas_object_textgrid_cellrow_get(sd->grid.obj, y);
         if (!tc) continue;
         ch1 = -1;
+        if ((smask) &&
+            (termio_search_row_mask(sd->search, y - sd->scroll,
+                                    sd->grid.w, smask)))
+          sm = smask;
+        // links drawn last time, so they do not count as changes
+        if (lmask) termio_links_row_mask(sd->links, y, lmask);
         for (x = 0; x < sd->grid.w; x++)
           {
              if ((!cells) || (x >= w))
@@ -4244,40 +4512,61 @@ _smart_apply(Evas_Object *obj)
                     }
                   else
                     {
-                       int fg, bg, fgext, bgext, codepoint;
+                       int fg, bg, fgext, bgext, fgrgb, bgrgb, codepoint;
+                       int ul = cells[x].att.underline;
+                       int cinv = cells[x].att.inverse ^ inv;
 
                        // colors
                        fg = cells[x].att.fg;
                        bg = cells[x].att.bg;
                        fgext = cells[x].att.fg256;
                        bgext = cells[x].att.bg256;
+                       fgrgb = cells[x].att.fgrgb;
+                       bgrgb = cells[x].att.bgrgb;
                        codepoint = cells[x].codepoint;
+                       // search matches show inverted, the selected one
+                       // underlined too
+                       if ((sm) && (sm[x]))
+                         {
+                            cinv = !cinv;
+                            if (sm[x] == 2) ul = 1;
+                         }
 
-                       if ((fg == COL_DEF) && (cells[x].att.inverse ^ inv))
+                       // 24bit colors are standard palette entries that
+                       // intense, bold and faint leave alone
+                       if (fgrgb) fg += TERMPTY_RGB_BASE;
+                       if (bgrgb) bg += TERMPTY_RGB_BASE;
+                       if ((fg == COL_DEF) && (cinv))
                          fg = COL_INVERSEBG;
                        if (bg == COL_DEF)
                          {
-                            if (cells[x].att.inverse ^ inv)
+                            if (cinv)
                               bg = COL_INVERSE;
                             else if (!bgext)
                               bg = COL_INVIS;
                          }
-                       if ((cells[x].att.fgintense) && (!fgext)) fg += 48;
-                       if ((cells[x].att.bgintense) && (!bgext)) bg += 48;
-                       if (cells[x].att.inverse ^ inv)
+                       if ((cells[x].att.fgintense) && (!fgext) && (!fgrgb))
+                         fg += 48;
+                       if ((cells[x].att.bgintense) && (!bgext) && (!bgrgb))
+                         bg += 48;
+                       if (cinv)
                          {
                             int t;
                             t = fgext; fgext = bgext; bgext = t;
+                            t = fgrgb; fgrgb = bgrgb; bgrgb = t;
                             t = fg; fg = bg; bg = t;
                          }
-                       if ((cells[x].att.bold) && (!fgext)) fg += 12;
-                       if ((cells[x].att.faint) && (!fgext)) fg += 24;
+                       if ((cells[x].att.bold) && (!fgext) && (!fgrgb))
+                         fg += 12;
+                       if ((cells[x].att.faint) && (!fgext) && (!fgrgb))
+                         fg += 24;
+                       if ((lmask) && (lmask[x])) ul = 1;
                        if ((tc[x].codepoint != codepoint) ||
                            (tc[x].fg != fg) ||
                            (tc[x].bg != bg) ||
                            (tc[x].fg_extended != fgext) ||
                            (tc[x].bg_extended != bgext) ||
-                           (tc[x].underline != cells[x].att.underline) ||
+                           (tc[x].underline != ul) ||
                            (tc[x].strikethrough != cells[x].att.strike))
                          {
                             if (ch1 < 0) ch1 = x;
@@ -4285,7 +4574,7 @@ _smart_apply(Evas_Object *obj)
                          }
                        tc[x].fg_extended = fgext;
                        tc[x].bg_extended = bgext;
-                       tc[x].underline = cells[x].att.underline;
+                       tc[x].underline = ul;
                        tc[x].strikethrough = cells[x].att.strike;
                        tc[x].fg = fg;
                        tc[x].bg = bg;
@@ -4302,6 +4591,21 @@ _smart_apply(Evas_Object *obj)
                     }
                }
           }
+        if (lmask)
+          {
+             int ya = termio_links_row_update(sd->links, obj, ch1 >= 0, y);
+
+             // rows above in the same line were drawn with the old links
+             if ((ya >= 0) && (ya < y))
+               {
+                  if (fix2 < 0) fix1 = ya;
+                  else fix1 = MIN(fix1, ya);
+                  fix2 = y - 1;
+               }
+             if (ya >= 0)
+               _smart_apply_links(sd, y, tc, cells, w, lmask, lmask2,
+                                  &ch1, &ch2);
+          }
         evas_object_textgrid_cellrow_set(sd->grid.obj, y, tc);
         /* only bothering to keep 1 change span per row - not worth doing
          * more really */
@@ -4309,6 +4613,24 @@ _smart_apply(Evas_Object *obj)
           evas_object_textgrid_update_add(sd->grid.obj, ch1, y,
                                           ch2 - ch1 + 1, 1);
      }
+   for (y = fix1; y <= fix2; y++)
+     {
+        Termcell *cells;
+        Evas_Textgrid_Cell *tc;
+
+        w = 0;
+        cells = termpty_cellrow_get(sd->pty, y - sd->scroll, &w);
+        tc = evas_object_textgrid_cellrow_get(sd->grid.obj, y);
+        if (!tc) continue;
+        ch1 = -1;
+        for (x = 0; x < sd->grid.w; x++)
+          lmask[x] = tc[x].underline;
+        _smart_apply_links(sd, y, tc, cells, w, lmask, lmask2, &ch1, &ch2);
+        evas_object_textgrid_cellrow_set(sd->grid.obj, y, tc);
+        if (ch1 >= 0)
+          evas_object_textgrid_update_add(sd->grid.obj, ch1, y,
+                                          ch2 - ch1 + 1, 1);
+     }
    if (sd->preedit_str)
      {
         Eina_Unicode *uni, g;
@@ -4772,9 +5094,14 @@ _smart_del(Evas_Object *obj)
    if (sd->link_do_timer) ecore_timer_del(sd->link_do_timer);
    if (sd->mouse_move_job) ecore_job_del(sd->mouse_move_job);
    if (sd->mouseover_delay) ecore_timer_del(sd->mouseover_delay);
+   if (sd->stats.timer) ecore_timer_del(sd->stats.timer);
+   if (sd->stats.obj) evas_object_del(sd->stats.obj);
    if (sd->font.name) eina_stringshare_del(sd->font.name);
+   termio_export_free(sd->export);
    if (sd->pty) termpty_free(sd->pty);
    if (sd->link.string) free(sd->link.string);
+   termio_links_free(sd->links);
+   termio_search_free(sd->search);
    if (sd->glayer) evas_object_del(sd->glayer);
    if (sd->win)
      evas_object_event_callback_del_full(sd->win, EVAS_CALLBACK_DEL,
@@ -4786,7 +5113,8 @@ _smart_del(Evas_Object *obj)
      }
    if (sd->link.down.dndobj) evas_object_del(sd->link.down.dndobj);
    keyin_compose_seq_reset(&sd->khdl);
-   if (sd->sel_str) eina_stringshare_del(sd->sel_str);
+   free(sd->sel_str);
+   _selget_cancel(sd);
    if (sd->preedit_str) eina_stringshare_del(sd->preedit_str);
    if (sd->sel_reset_job) ecore_job_del(sd->sel_reset_job);
    EINA_LIST_FREE(sd->cur_chids, chid) eina_stringshare_del(chid);
@@ -4801,6 +5129,8 @@ _smart_del(Evas_Object *obj)
    sd->sel.theme = NULL;
    sd->anim = NULL;
    sd->delayed_size_timer = NULL;
+   sd->stats.timer = NULL;
+   sd->stats.obj = NULL;
    sd->font.name = NULL;
    sd->pty = NULL;
    sd->khdl.imf = NULL;
@@ -4821,8 +5151,10 @@ _smart_resize(Evas_Object *obj, Evas_Coord w, Evas_Coord h)
    evas_object_geometry_get(obj, NULL, NULL, &ow, &oh);
    if ((ow == w) && (oh == h)) return;
    evas_object_smart_changed(obj);
+   // while a split is dragged only resize once it stops moving for a bit
    if (!sd->delayed_size_timer)
-     sd->delayed_size_timer = ecore_timer_add(0.0, _smart_cb_delayed_size, obj);
+     sd->delayed_size_timer = ecore_timer_add(sd->size_defer ? 0.25 : 0.0,
+                                              _smart_cb_delayed_size, obj);
    else ecore_timer_reset(sd->delayed_size_timer);
    evas_object_resize(sd->event, ow, oh);
 }
@@ -4846,6 +5178,12 @@ _smart_calculate(Evas_Object *obj)
 
    evas_object_move(sd->event, ox, oy);
    evas_object_resize(sd->event, ow, oh);
+   if (sd->zoom > 0.0) _smart_zoom_map_apply(sd);
+   if (sd->stats.obj)
+     {
+        evas_object_move(sd->stats.obj, ox, oy);
+        evas_object_resize(sd->stats.obj, ow, oh);
+     }
 }
 
 static void
@@ -5154,6 +5492,28 @@ _smart_pty_command(void *data)
              termpty_write(sd->pty, buf, strlen(buf));
              return;
           }
+        else if (sd->pty->cur_cmd[1] == 'm')
+          {
+             Termsave_Stats st;
+             char buf[512];
+             int buflen;
+
+             // scrollback of this terminal only, the process wide numbers
+             // cover other tabs too and stay in the overlay
+             termpty_save_stats_get(sd->pty, &st);
+             buflen = snprintf(buf, sizeof(buf),
+                               "%c}stats;%i;%i;%i;%i;%i;%i;%llu;%llu;%llu;"
+                               "%llu", 0x1b,
+                               st.rows_raw, st.rows_comp, st.rows_cold,
+                               st.rows_spilled, st.rows_shared, st.rows_blank,
+                               (unsigned long long)st.bytes_resident,
+                               (unsigned long long)st.bytes_cells,
+                               (unsigned long long)st.bytes_comp,
+                               (unsigned long long)st.bytes_spilled);
+             if ((buflen < 0) || (buflen >= (int)sizeof(buf))) return;
+             termpty_write(sd->pty, buf, buflen + 1);
+             return;
+          }
         else if (sd->pty->cur_cmd[1] == 'j')
           {
              const char *chid = &(sd->pty->cur_cmd[3]);
@@ -5334,7 +5694,8 @@ termio_add(Evas_Object *parent, Config *config,
                        _smart_cb_drop, obj);
 #endif
 
-   sd->pty = termpty_new(cmd, login_shell, cd, w, h, config->scrollback,
+   sd->pty = termpty_new(cmd, login_shell, cd, w, h,
+                         _scrollback_lines_get(config),
                          config->xterm_256color, config->erase_is_del, mod);
    if (!sd->pty)
      {
@@ -5342,6 +5703,11 @@ termio_add(Evas_Object *parent, Config *config,
         evas_object_del(obj);
         return NULL;
      }
+   termpty_save_budget_set((uint64_t)config->scrollback_budget * 1024 * 1024);
+   if (config->scrollback_spill) termpty_save_spill_set(sd->pty, EINA_TRUE);
+   termpty_index_budget_set((uint64_t)config->search_index_budget *
+                            1024 * 1024);
+   if (config->search_index) termpty_index_set(sd->pty, EINA_TRUE);
    sd->pty->obj = obj;
    sd->pty->cb.change.func = _smart_pty_change;
    sd->pty->cb.change.data = obj;
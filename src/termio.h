@@ -46,5 +46,10 @@ Config      *termio_config_get(const Evas_Object *obj);
 Termpty *termio_pty_get(Evas_Object *obj);
 Evas_Object * termio_miniview_get(Evas_Object *obj);
 Term* termio_term_get(Evas_Object *obj);
+void termio_stats_toggle(Evas_Object *obj);
+void termio_search_set(Evas_Object *obj, const char *str, Eina_Bool regex);
+void termio_search_next(Evas_Object *obj, Eina_Bool older);
+void termio_export(Evas_Object *obj, const char *path, Eina_Bool sgr);
+void termio_size_defer_set(Evas_Object *obj, Eina_Bool defer);
 
 #endif
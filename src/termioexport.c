@@ -0,0 +1,483 @@
+#include "private.h"
+
+#include <Elementary.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "termpty.h"
+#include "termioexport.h"
+#include "utf8.h"
+
+/* seconds of history turned into text per idler call */
+#define EXPORT_SLICE 0.004
+/* bytes handed to the writer thread at once */
+#define EXPORT_JOB_BYTES (256 * 1024)
+/* longest sgr sequence _sgr_get() makes, with room to spare */
+#define EXPORT_SGR_MAX 64
+
+/* the screen is turned into text as the export starts, history after it
+ * in idle time from the oldest row down, so the file is what was there
+ * when the export began. rows are read through views, that decompress
+ * into scratch of their own and leave the history ring as it is.
+ *
+ * writing can block for long, a thread does that a chunk at a time while
+ * the idler waits for it */
+
+typedef struct _Termexportbuf Termexportbuf;
+struct _Termexportbuf
+{
+   char *text;
+   size_t len, size;
+};
+
+typedef struct _Termexportjob Termexportjob;
+struct _Termexportjob
+{
+   Termexport *ex; /* NULL once the export has let go of the job */
+   Ecore_Thread *thread;
+   Termexportbuf buf;
+   int fd;
+   int err;
+   long long rows;
+   Eina_Bool last;
+   Eina_Bool written;
+};
+
+struct _Termexport
+{
+   Termpty *ty;
+   const char *path;
+   int fd;
+   Eina_Bool sgr;
+   Termexport_State state;
+   Ecore_Idler *idler;
+   Termexportjob *job; /* being written by the thread, if any */
+   Termexportjob *fill; /* being filled by the idler */
+   Termexportbuf screen;
+   long long next, end; /* history rows still to do, end not included */
+   long long rows, rows_done;
+   long long lost; /* rows that fell out of history before their turn */
+   unsigned int backgen;
+   void (*cb)(void *data, Termexport *ex);
+   const void *data;
+   Termrow view;
+   /* sgr of each palette entry of the row in view, and the one in effect */
+   char pal_sgr[256][EXPORT_SGR_MAX];
+   unsigned char pal_ok[256];
+   char cur_sgr[EXPORT_SGR_MAX];
+   int cur_link; /* explicit link in effect, closed at each line end */
+};
+
+static const char _sgr_reset[] = "\033[0m";
+
+static Eina_Bool
+_buf_grow(Termexportbuf *b, size_t len)
+{
+   char *text;
+   size_t size;
+
+   if ((b->len + len) <= b->size) return EINA_TRUE;
+   size = ((b->len + len + 4095) / 4096) * 4096;
+   text = realloc(b->text, size);
+   if (!text) return EINA_FALSE;
+   b->text = text;
+   b->size = size;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_buf_add(Termexportbuf *b, const char *s, size_t len)
+{
+   if (!_buf_grow(b, len)) return EINA_FALSE;
+   memcpy(b->text + b->len, s, len);
+   b->len += len;
+   return EINA_TRUE;
+}
+
+static int
+_sgr_color(char *p, const Termpty *ty, unsigned char col, Eina_Bool is256,
+           Eina_Bool isrgb, Eina_Bool intense, int base)
+{
+   if (isrgb)
+     {
+        unsigned int rgb;
+
+        if (col >= ty->rgb.num) return 0;
+        rgb = ty->rgb.colors[col];
+        return sprintf(p, ";%i;2;%u;%u;%u", base + 8,
+                       (rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff);
+     }
+   if (is256) return sprintf(p, ";%i;5;%i", base + 8, col);
+   if ((col < COL_BLACK) || (col > COL_WHITE)) return 0;
+   return sprintf(p, ";%i", (intense ? base + 60 : base) + col - COL_BLACK);
+}
+
+static void
+_sgr_get(const Termpty *ty, const Termatt *att, char *buf)
+{
+   char *p = buf;
+
+   p += sprintf(p, "\033[0");
+   if (att->bold) p += sprintf(p, ";1");
+   if (att->faint) p += sprintf(p, ";2");
+#if defined(SUPPORT_ITALIC)
+   if (att->italic) p += sprintf(p, ";3");
+#endif
+   if (att->underline) p += sprintf(p, ";4");
+   if (att->blink) p += sprintf(p, ";5");
+   if (att->inverse) p += sprintf(p, ";7");
+   if (att->invisible) p += sprintf(p, ";8");
+   if (att->strike) p += sprintf(p, ";9");
+   p += _sgr_color(p, ty, att->fg, att->fg256, att->fgrgb, att->fgintense, 30);
+   p += _sgr_color(p, ty, att->bg, att->bg256, att->bgrgb, att->bgintense, 40);
+   sprintf(p, "m");
+}
+
+static Eina_Bool
+_sgr_set(Termexport *ex, Termexportbuf *b, const char *sgr)
+{
+   if (!strcmp(ex->cur_sgr, sgr)) return EINA_TRUE;
+   strcpy(ex->cur_sgr, sgr);
+   return _buf_add(b, sgr, strlen(sgr));
+}
+
+/* osc 8 to go into link, or out of any for 0 */
+static Eina_Bool
+_link_set(Termexport *ex, Termexportbuf *b, int link)
+{
+   const char *uri = termpty_hyperlink_uri_get(ex->ty, link);
+
+   if (link == ex->cur_link) return EINA_TRUE;
+   ex->cur_link = link;
+   return (_buf_add(b, "\033]8;;", 5)) &&
+     ((!uri) || (_buf_add(b, uri, strlen(uri)))) &&
+     (_buf_add(b, "\033\\", 2));
+}
+
+/* the row in view as a line of text, ended by a newline unless it wraps */
+static Eina_Bool
+_row_add(Termexport *ex, Termexportbuf *b)
+{
+   const Termrow *row = &(ex->view);
+   const Eina_Unicode *cp = row->codepoints;
+   Eina_Bool wrapped;
+   int x, n, last = -1;
+
+   wrapped = (row->w > 0) && (row->pal[row->idx[row->w - 1]].att.autowrapped);
+   n = wrapped ? row->w : termpty_row_view_length(row);
+   if (!_buf_grow(b, (n * 6) + 1)) return EINA_FALSE;
+   if (ex->sgr) memset(ex->pal_ok, 0, row->npal);
+   for (x = 0; x < n; x++)
+     {
+        Eina_Unicode g = cp[x];
+
+#if defined(SUPPORT_DBLWIDTH)
+        if ((g == 0) && (row->pal[row->idx[x]].att.dblwidth)) continue;
+#endif
+        if ((ex->sgr) && (row->idx[x] != last))
+          {
+             last = row->idx[x];
+             if (!ex->pal_ok[last])
+               {
+                  _sgr_get(ex->ty, &(row->pal[last].att), ex->pal_sgr[last]);
+                  ex->pal_ok[last] = 1;
+               }
+             if ((!_sgr_set(ex, b, ex->pal_sgr[last])) ||
+                 (!_link_set(ex, b, row->pal[last].link)))
+               return EINA_FALSE;
+             if (!_buf_grow(b, ((n - x) * 6) + 1)) return EINA_FALSE;
+          }
+        if (g < 0x80)
+          b->text[b->len++] = g ? g : ' ';
+        else
+          b->len += codepoint_to_utf8(g, b->text + b->len);
+     }
+   if (wrapped) return EINA_TRUE;
+   if ((ex->sgr) &&
+       ((!_sgr_set(ex, b, _sgr_reset)) || (!_link_set(ex, b, 0))))
+     return EINA_FALSE;
+   return _buf_add(b, "\n", 1);
+}
+
+static void
+_fill_free(Termexport *ex)
+{
+   if (!ex->fill) return;
+   free(ex->fill->buf.text);
+   free(ex->fill);
+   ex->fill = NULL;
+}
+
+static void
+_finish(Termexport *ex, Termexport_State state)
+{
+   if (ex->idler)
+     {
+        ecore_idler_del(ex->idler);
+        ex->idler = NULL;
+     }
+   _fill_free(ex);
+   if (ex->fd >= 0)
+     {
+        if ((close(ex->fd) < 0) && (state == TERMIO_EXPORT_DONE))
+          {
+             ERR("Could not write export %s: %s", ex->path, strerror(errno));
+             state = TERMIO_EXPORT_FAILED;
+          }
+        ex->fd = -1;
+     }
+   termpty_row_view_free(&(ex->view));
+   free(ex->screen.text);
+   memset(&(ex->screen), 0, sizeof(ex->screen));
+   ex->state = state;
+   if ((state == TERMIO_EXPORT_DONE) && (ex->lost > 0))
+     WRN("Export %s misses %lli rows that left history before written",
+         ex->path, ex->lost);
+   if (ex->cb) ex->cb((void *)ex->data, ex);
+}
+
+static void
+_job_run(void *data, Ecore_Thread *thread)
+{
+   Termexportjob *job = data;
+   size_t off = 0;
+
+   while (off < job->buf.len)
+     {
+        ssize_t n;
+
+        if (ecore_thread_check(thread)) return;
+        n = write(job->fd, job->buf.text + off, job->buf.len - off);
+        if (n < 0)
+          {
+             if (errno == EINTR) continue;
+             job->err = errno;
+             return;
+          }
+        off += n;
+     }
+   job->written = EINA_TRUE;
+}
+
+static Eina_Bool _cb_idle(void *data);
+
+/* called for a finished job as well as a cancelled one */
+static void
+_job_end(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Termexportjob *job = data;
+   Termexport *ex = job->ex;
+
+   if (!ex)
+     {
+        // the export went away, the fd was left to the job
+        close(job->fd);
+     }
+   else
+     {
+        ex->job = NULL;
+        // not run at all if no thread could be had
+        if ((!job->written) && (!job->err)) job->err = ECANCELED;
+        if (job->err)
+          {
+             ERR("Could not write export %s: %s",
+                 ex->path, strerror(job->err));
+             _finish(ex, TERMIO_EXPORT_FAILED);
+          }
+        else
+          {
+             ex->rows_done += job->rows;
+             if (job->last)
+               _finish(ex, TERMIO_EXPORT_DONE);
+             else
+               {
+                  if (!ex->idler) ex->idler = ecore_idler_add(_cb_idle, ex);
+                  if (ex->cb) ex->cb((void *)ex->data, ex);
+               }
+          }
+     }
+   free(job->buf.text);
+   free(job);
+}
+
+static void
+_job_start(Termexport *ex, Termexportjob *job)
+{
+   Ecore_Thread *thread;
+
+   job->ex = ex;
+   job->fd = ex->fd;
+   ex->job = job;
+   thread = ecore_thread_run(_job_run, _job_end, _job_end, job);
+   // on failure the job has been ended already
+   if (thread) job->thread = thread;
+}
+
+static Eina_Bool
+_cb_idle(void *data)
+{
+   Termexport *ex = data;
+   Termpty *ty = ex->ty;
+   Termexportjob *job;
+   double t0 = ecore_time_get();
+
+   if (ty->backgen != ex->backgen)
+     {
+        ERR("History of export %s changed as it was written", ex->path);
+        ex->idler = NULL;
+        _finish(ex, TERMIO_EXPORT_FAILED);
+        return ECORE_CALLBACK_CANCEL;
+     }
+   if (!ex->fill) ex->fill = calloc(1, sizeof(Termexportjob));
+   job = ex->fill;
+   if (!job) return ECORE_CALLBACK_RENEW;
+   termpty_cellcomp_freeze(ty);
+   while ((ex->next < ex->end) && (job->buf.len < EXPORT_JOB_BYTES))
+     {
+        long long oldest = ty->backsaved - ty->backscroll_num;
+
+        if (ex->next < oldest)
+          {
+             ex->lost += MIN(oldest, ex->end) - ex->next;
+             ex->rows_done += MIN(oldest, ex->end) - ex->next;
+             ex->next = oldest;
+             continue;
+          }
+        if ((termpty_row_view_get(ty, ex->next - ty->backsaved,
+                                  &(ex->view))) &&
+            (!_row_add(ex, &(job->buf))))
+          goto nomem;
+        ex->next++;
+        job->rows++;
+        if ((ecore_time_get() - t0) >= EXPORT_SLICE) break;
+     }
+   termpty_cellcomp_thaw(ty);
+   // a thread for each slice would cost more than the writing
+   if ((ex->next < ex->end) && (job->buf.len < EXPORT_JOB_BYTES))
+     return ECORE_CALLBACK_RENEW;
+   if (ex->next >= ex->end)
+     {
+        // history is done, the screen goes last
+        job->last = EINA_TRUE;
+        job->rows = ex->rows - ex->rows_done;
+        // it was made starting from no attributes
+        if (((ex->sgr) && ((!_sgr_set(ex, &(job->buf), _sgr_reset)) ||
+                           (!_link_set(ex, &(job->buf), 0)))) ||
+            (!_buf_add(&(job->buf), ex->screen.text, ex->screen.len)))
+          {
+             termpty_cellcomp_freeze(ty);
+             goto nomem;
+          }
+     }
+   ex->fill = NULL;
+   ex->idler = NULL;
+   _job_start(ex, job);
+   return ECORE_CALLBACK_CANCEL;
+
+nomem:
+   termpty_cellcomp_thaw(ty);
+   ERR("Could not export %s: out of memory", ex->path);
+   ex->idler = NULL;
+   _finish(ex, TERMIO_EXPORT_FAILED);
+   return ECORE_CALLBACK_CANCEL;
+}
+
+Termexport *
+termio_export_new(Termpty *ty, const char *path, Eina_Bool sgr,
+                  void (*cb)(void *data, Termexport *ex), const void *data)
+{
+   Termexport *ex;
+   int y;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, NULL);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(path, NULL);
+   ex = calloc(1, sizeof(Termexport));
+   if (!ex) return NULL;
+   ex->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+   if (ex->fd < 0)
+     {
+        ERR("Could not open export %s: %s", path, strerror(errno));
+        free(ex);
+        return NULL;
+     }
+   ex->ty = ty;
+   ex->path = eina_stringshare_add(path);
+   ex->sgr = !!sgr;
+   ex->cb = cb;
+   ex->data = data;
+   ex->state = TERMIO_EXPORT_RUNNING;
+   ex->backgen = ty->backgen;
+   ex->next = ty->backsaved - ty->backscroll_num;
+   ex->end = ty->backsaved;
+   ex->rows = (ex->end - ex->next) + ty->h;
+   strcpy(ex->cur_sgr, _sgr_reset);
+
+   termpty_cellcomp_freeze(ty);
+   for (y = 0; y < ty->h; y++)
+     {
+        if ((termpty_row_view_get(ty, y, &(ex->view))) &&
+            (!_row_add(ex, &(ex->screen))))
+          {
+             termpty_cellcomp_thaw(ty);
+             ERR("Could not export %s: out of memory", path);
+             termio_export_free(ex);
+             return NULL;
+          }
+     }
+   termpty_cellcomp_thaw(ty);
+   // history goes on from the state the screen ended in, begin it afresh
+   if ((ex->sgr) && (ex->screen.len > 0) &&
+       ((!_buf_add(&(ex->screen), _sgr_reset, strlen(_sgr_reset))) ||
+        (!_link_set(ex, &(ex->screen), 0))))
+     {
+        ERR("Could not export %s: out of memory", path);
+        termio_export_free(ex);
+        return NULL;
+     }
+   strcpy(ex->cur_sgr, _sgr_reset);
+   ex->idler = ecore_idler_add(_cb_idle, ex);
+   return ex;
+}
+
+void
+termio_export_free(Termexport *ex)
+{
+   if (!ex) return;
+   if (ex->idler) ecore_idler_del(ex->idler);
+   if (ex->job)
+     {
+        // the job closes the fd when it ends
+        ex->job->ex = NULL;
+        ex->fd = -1;
+        if (ex->job->thread) ecore_thread_cancel(ex->job->thread);
+     }
+   _fill_free(ex);
+   if (ex->fd >= 0) close(ex->fd);
+   termpty_row_view_free(&(ex->view));
+   free(ex->screen.text);
+   eina_stringshare_del(ex->path);
+   free(ex);
+}
+
+Termexport_State
+termio_export_state_get(const Termexport *ex)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ex, TERMIO_EXPORT_FAILED);
+   return ex->state;
+}
+
+double
+termio_export_progress_get(const Termexport *ex)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ex, 0.0);
+   if (ex->state == TERMIO_EXPORT_DONE) return 1.0;
+   if (ex->rows <= 0) return 0.0;
+   return (double)ex->rows_done / (double)ex->rows;
+}
+
+const char *
+termio_export_path_get(const Termexport *ex)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ex, NULL);
+   return ex->path;
+}
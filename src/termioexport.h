@@ -0,0 +1,27 @@
+#ifndef _TERMIO_EXPORT_H__
+#define _TERMIO_EXPORT_H__ 1
+
+typedef struct _Termexport Termexport;
+
+typedef enum _Termexport_State
+{
+   TERMIO_EXPORT_RUNNING,
+   TERMIO_EXPORT_DONE,
+   TERMIO_EXPORT_FAILED
+} Termexport_State;
+
+/* write history and screen of ty as they are now to path, as text or with
+ * sgr escapes for the attributes. cb is called from the main loop as
+ * chunks get written and once more when done or failed, from then on ex
+ * is left alone and may be freed in cb */
+Termexport *termio_export_new(Termpty *ty, const char *path, Eina_Bool sgr,
+                              void (*cb)(void *data, Termexport *ex),
+                              const void *data);
+/* stops an export still running, what was written so far stays */
+void termio_export_free(Termexport *ex);
+Termexport_State termio_export_state_get(const Termexport *ex);
+/* 0.0 to 1.0 of the rows written */
+double termio_export_progress_get(const Termexport *ex);
+const char *termio_export_path_get(const Termexport *ex);
+
+#endif
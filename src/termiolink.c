@@ -1,40 +1,175 @@
 #include "private.h"
 #include <Elementary.h>
 #include "termio.h"
+#include "termiolink.h"
 #include "utils.h"
 
+/* reads cells of the visible grid for the link scanner. rows come from
+ * views so scrollback is read where it is without being decompressed,
+ * the two most recent rows are kept since scans cross a row at a time */
+typedef struct _Linkscan Linkscan;
+struct _Linkscan
+{
+   Termpty *ty;
+   int w, h, sc;
+   struct {
+      Termrow view;
+      const Termcell *cells; // if the row has too many attributes for a view
+      int y, w;
+   } rows[2];
+   int next;
+};
+
+static int
+_scan_row_load(Linkscan *ls, int y)
+{
+   int i, w = 0;
+
+   for (i = 0; i < 2; i++)
+     {
+        if (ls->rows[i].y == y) return i;
+     }
+   i = ls->next;
+   ls->next = !ls->next;
+   ls->rows[i].y = y;
+   ls->rows[i].cells = NULL;
+   if (termpty_row_view_get(ls->ty, y - ls->sc, &(ls->rows[i].view)))
+     w = ls->rows[i].view.w;
+   else
+     {
+        ls->rows[i].cells = termpty_cellrow_get(ls->ty, y - ls->sc, &w);
+        if (!ls->rows[i].cells) w = 0;
+     }
+   ls->rows[i].w = MIN(w, ls->w);
+   return i;
+}
+
+/* codepoint at x,y with blanks past the end of the row as 0 */
+static Eina_Unicode
+_scan_cell_get(Linkscan *ls, int x, int y, const Termatt **att)
+{
+   static const Termatt blank;
+   int i = _scan_row_load(ls, y);
+
+   *att = &blank;
+   if (x >= ls->rows[i].w) return 0;
+   if (ls->rows[i].cells)
+     {
+        *att = &(ls->rows[i].cells[x].att);
+        return ls->rows[i].cells[x].codepoint;
+     }
+   *att = &(ls->rows[i].view.pal[ls->rows[i].view.idx[x]].att);
+   return ls->rows[i].view.codepoints[x];
+}
+
+/* explicit link of the cell at x,y, 0 for none */
+static int
+_scan_cell_link(Linkscan *ls, int x, int y)
+{
+   int i = _scan_row_load(ls, y);
+
+   if (x >= ls->rows[i].w) return 0;
+   if (ls->rows[i].cells) return ls->rows[i].cells[x].link;
+   return ls->rows[i].view.pal[ls->rows[i].view.idx[x]].link;
+}
+
+/* whether text goes on from the end of row y to the next one */
+static Eina_Bool
+_scan_row_wrapped(Linkscan *ls, int y)
+{
+   const Termatt *att;
+
+   if (y >= (ls->h - 1)) return EINA_FALSE;
+   _scan_cell_get(ls, ls->w - 1, y, &att);
+   return att->autowrapped;
+}
+
 static Eina_Bool
-coord_back(int *x, int *y, int w, int h EINA_UNUSED)
+_scan_back(Linkscan *ls, int *x, int *y)
 {
-   (*x)--;
-   if ((*x) < 0)
+   if (*x > 0)
      {
-        if ((*y) <= 0)
-          {
-             (*x)++;
-             return EINA_FALSE;
-          }
-        (*x) = w - 1;
-        (*y)--;
+        (*x)--;
+        return EINA_TRUE;
      }
+   if ((*y <= 0) || (!_scan_row_wrapped(ls, *y - 1))) return EINA_FALSE;
+   (*y)--;
+   *x = ls->w - 1;
    return EINA_TRUE;
 }
 
 static Eina_Bool
-coord_forward(int *x, int *y, int w, int h)
+_scan_forward(Linkscan *ls, int *x, int *y)
 {
-   (*x)++;
-   if ((*x) >= w)
+   if (*x < (ls->w - 1))
      {
-        if ((*y) >= (h - 1))
+        (*x)++;
+        return EINA_TRUE;
+     }
+   if (!_scan_row_wrapped(ls, *y)) return EINA_FALSE;
+   (*y)++;
+   *x = 0;
+   return EINA_TRUE;
+}
+
+/* what separates a link from the text around it. the right half of a
+ * double width char is part of that char */
+static Eina_Bool
+_scan_is_space(Eina_Unicode g, const Termatt *att)
+{
+#if defined(SUPPORT_DBLWIDTH)
+   if ((g == 0) && (att->dblwidth)) return EINA_FALSE;
+#endif
+   if ((g == 0) || (att->newline) || (att->tab)) return EINA_TRUE;
+   return (g < 0x80) && (isspace(g));
+}
+
+static char
+_scan_endmatch(Eina_Unicode g)
+{
+   switch (g)
+     {
+      case '"': return '"';
+      case '\'': return '\'';
+      case '`': return '`';
+      case '<': return '>';
+      case '[': return ']';
+      case '{': return '}';
+      case '(': return ')';
+     }
+   return 0;
+}
+
+/* same as link_is_protocol() on the text starting at x,y */
+static Eina_Bool
+_scan_is_protocol(Linkscan *ls, int x, int y)
+{
+   static const char *protocols[] = {
+      "http://", "https://", "ftp://", "file://", "mailto:", NULL
+   };
+   char buf[8];
+   const Termatt *att;
+   int n, i;
+
+   for (n = 0; n < (int)sizeof(buf) - 1; n++)
+     {
+        Eina_Unicode g = _scan_cell_get(ls, x, y, &att);
+
+        if ((g == 0) || (g >= 0x80)) break;
+        buf[n] = g;
+        if (!_scan_forward(ls, &x, &y))
           {
-             (*x)--;
-             return EINA_FALSE;
+             n++;
+             break;
           }
-        (*x) = 0;
-        (*y)++;
      }
-   return EINA_TRUE;
+   buf[n] = 0;
+   for (i = 0; protocols[i]; i++)
+     {
+        if (!strncasecmp(buf, protocols[i], strlen(protocols[i])))
+          return EINA_TRUE;
+     }
+   return EINA_FALSE;
 }
 
 static char *
@@ -94,141 +229,525 @@ _is_file(const char *str)
      }
 }
 
+static Eina_Bool
+_scan_begin(Linkscan *ls, Evas_Object *obj)
+{
+   memset(ls, 0, sizeof(Linkscan));
+   termio_size_get(obj, &ls->w, &ls->h);
+   if ((ls->w <= 0) || (ls->h <= 0)) return EINA_FALSE;
+   ls->ty = termio_pty_get(obj);
+   if (!ls->ty) return EINA_FALSE;
+   ls->sc = termio_scroll_get(obj);
+   ls->rows[0].y = ls->rows[1].y = INT_MIN;
+   termpty_cellcomp_freeze(ls->ty);
+   return EINA_TRUE;
+}
+
+static void
+_scan_end(Linkscan *ls)
+{
+   int i;
+
+   termpty_cellcomp_thaw(ls->ty);
+   for (i = 0; i < 2; i++)
+     termpty_row_view_free(&(ls->rows[i].view));
+}
+
+/* text of the span if it is a link, with relative paths made absolute */
+static char *
+_scan_link_get(Linkscan *ls, Evas_Object *obj, int x1, int y1, int x2, int y2)
+{
+   char *s;
+   size_t len = 0;
+
+   s = termio_selection_get(obj, x1, y1 - ls->sc, x2, y2 - ls->sc, &len);
+   if ((s) && (len > 1))
+     {
+        Eina_Bool is_file = _is_file(s);
+
+        if (is_file ||
+            link_is_email(s) ||
+            link_is_url(s))
+          {
+             if (is_file && (s[0] != '/'))
+               {
+                  char *ret = _local_path_get(obj, s);
+                  free(s);
+                  s = ret;
+               }
+             return s;
+          }
+     }
+   free(s);
+   return NULL;
+}
+
+/* the explicit link at cx,cy, if any, and the cells around it in it too */
+static char *
+_scan_explicit(Linkscan *ls, int cx, int cy,
+               int *x1r, int *y1r, int *x2r, int *y2r)
+{
+   const char *uri;
+   int link, x, y, x1, y1, x2, y2;
+
+   link = _scan_cell_link(ls, cx, cy);
+   if (!link) return NULL;
+   uri = termpty_hyperlink_uri_get(ls->ty, link);
+   if (!uri) return NULL;
+   x1 = x = cx;
+   y1 = y = cy;
+   while ((_scan_back(ls, &x, &y)) && (_scan_cell_link(ls, x, y) == link))
+     {
+        x1 = x;
+        y1 = y;
+     }
+   x2 = x = cx;
+   y2 = y = cy;
+   while ((_scan_forward(ls, &x, &y)) && (_scan_cell_link(ls, x, y) == link))
+     {
+        x2 = x;
+        y2 = y;
+     }
+   if (x1r) *x1r = x1;
+   if (y1r) *y1r = y1;
+   if (x2r) *x2r = x2;
+   if (y2r) *y2r = y2;
+   return strdup(uri);
+}
+
 char *
 _termio_link_find(Evas_Object *obj, int cx, int cy,
                   int *x1r, int *y1r, int *x2r, int *y2r)
 {
-   char *s;
+   Linkscan ls;
+   const Termatt *att;
+   Eina_Unicode g;
+   char *s = NULL;
    char endmatch = 0;
-   int x1, x2, y1, y2, w = 0, h = 0, sc;
-   size_t len = 0, prev_len = 0;
-   Eina_Bool goback = EINA_TRUE, goforward = EINA_FALSE, escaped = EINA_FALSE;
-
-   x1 = x2 = cx;
-   y1 = y2 = cy;
-   termio_size_get(obj, &w, &h);
-   if ((w <= 0) || (h <= 0)) return NULL;
-   sc = termio_scroll_get(obj);
+   int x1, x2, y1, y2, x, y;
+   Eina_Bool escaped = EINA_FALSE;
+
+   if (!_scan_begin(&ls, obj)) return NULL;
+   if ((cx < 0) || (cx >= ls.w) || (cy < 0) || (cy >= ls.h)) goto end;
+
+   // links the application marked are taken as they are
+   s = _scan_explicit(&ls, cx, cy, x1r, y1r, x2r, y2r);
+   if (s) goto end;
+
+   g = _scan_cell_get(&ls, cx, cy, &att);
+   if ((_scan_is_space(g, att)) || (_scan_endmatch(g))) goto end;
+   escaped = (g == '\\');
+
+   /* back to a protocol, or to just after a space or opening quote */
+   x1 = x = cx;
+   y1 = y = cy;
    for (;;)
      {
-        prev_len = len;
-        s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc, &len);
-        if (!s) break;
-        if (goback)
+        if (_scan_is_protocol(&ls, x, y))
           {
-             if (link_is_protocol(s))
-               {
-                  goback = EINA_FALSE;
-                  goforward = EINA_TRUE;
+             x1 = x;
+             y1 = y;
+             if (_scan_back(&ls, &x, &y))
+               endmatch = _scan_endmatch(_scan_cell_get(&ls, x, y, &att));
+             break;
+          }
+        g = _scan_cell_get(&ls, x, y, &att);
+        if ((_scan_is_space(g, att)) || (_scan_endmatch(g)))
+          {
+             endmatch = _scan_endmatch(g);
+             break;
+          }
+        x1 = x;
+        y1 = y;
+        if (!_scan_back(&ls, &x, &y)) break;
+     }
 
-                  /* Check if the previous char is a delimiter */
-                  coord_back(&x1, &y1, w, h);
-                  free(s);
-                  s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                           &len);
-                  if (!s) break;
-                  switch (s[0])
-                    {
-                     case '"': endmatch = '"'; break;
-                     case '\'': endmatch = '\''; break;
-                     case '`': endmatch = '`'; break;
-                     case '<': endmatch = '>'; break;
-                     case '[': endmatch = ']'; break;
-                     case '{': endmatch = '}'; break;
-                     case '(': endmatch = ')'; break;
-                    }
-                  coord_forward(&x1, &y1, w, h);
+   /* forward to the closing quote or an unescaped space. the end of a row
+    * that did not wrap counts as a space */
+   x2 = x = cx;
+   y2 = y = cy;
+   for (;;)
+     {
+        if (!_scan_forward(&ls, &x, &y))
+          {
+             if ((x == (ls.w - 1)) && (y < (ls.h - 1))) endmatch = 0;
+             break;
+          }
+        g = _scan_cell_get(&ls, x, y, &att);
+        if (((endmatch) && (g == (Eina_Unicode)endmatch)) ||
+            ((!escaped) && (_scan_is_space(g, att))))
+          {
+             endmatch = 0;
+             break;
+          }
+        escaped = (g == '\\');
+        x2 = x;
+        y2 = y;
+     }
+   if (endmatch) goto end;
 
-                  free(s);
-                  prev_len = len;
-                  s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                           &len);
-                  if (!s) break;
-               }
-             else
+   /* only the final span is turned into text */
+   s = _scan_link_get(&ls, obj, x1, y1, x2, y2);
+   if (s)
+     {
+        if (x1r) *x1r = x1;
+        if (y1r) *y1r = y1;
+        if (x2r) *x2r = x2;
+        if (y2r) *y2r = y2;
+     }
+end:
+   _scan_end(&ls);
+   return s;
+}
+
+/* whole screen links. each logical line - rows joined by autowrap - is
+ * scanned once after it changes, with an automaton that finds every
+ * protocol, host prefix and @ in a single pass, and the spans found are
+ * kept per row so drawing and hovering just look them up */
+
+#define AC_STATES 64
+#define AC_HOST   5 // patterns before this are protocols
+#define AC_AT     7
+
+static const char *_ac_patterns[] = {
+   "http://", "https://", "ftp://", "file://", "mailto:",
+   "www.", "ftp.",
+   "@",
+   NULL
+};
+static unsigned char _ac_next[AC_STATES][128];
+static signed char _ac_match[AC_STATES];
+static Eina_Bool _ac_ready = EINA_FALSE;
+
+static void
+_ac_build(void)
+{
+   unsigned char trie[AC_STATES][128], fail[AC_STATES], queue[AC_STATES];
+   int num = 1, head = 0, tail = 0, i, c;
+
+   memset(trie, 0, sizeof(trie));
+   memset(_ac_match, -1, sizeof(_ac_match));
+   for (i = 0; _ac_patterns[i]; i++)
+     {
+        const char *p;
+        int s = 0;
+
+        for (p = _ac_patterns[i]; *p; p++)
+          {
+             if (!trie[s][(int)*p])
                {
-                  switch (s[0])
-                    {
-                     case '"': endmatch = '"'; break;
-                     case '\'': endmatch = '\''; break;
-                     case '`': endmatch = '`'; break;
-                     case '<': endmatch = '>'; break;
-                     case '[': endmatch = ']'; break;
-                     case '{': endmatch = '}'; break;
-                     case '(': endmatch = ')'; break;
-                    }
-                  if ((endmatch) || (isspace(s[0])))
-                    {
-                       goback = EINA_FALSE;
-                       coord_forward(&x1, &y1, w, h);
-                       goforward = EINA_TRUE;
-                       free(s);
-                       s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                                &len);
-                       if (!s) break;
-                    }
+                  if (num >= AC_STATES) abort();
+                  trie[s][(int)*p] = num++;
                }
+             s = trie[s][(int)*p];
           }
-        if ((goforward) && (len >= 1))
+        _ac_match[s] = i;
+     }
+   // breadth first so the fallback of a state is done before it
+   fail[0] = 0;
+   for (c = 0; c < 128; c++)
+     {
+        _ac_next[0][c] = trie[0][c];
+        if (trie[0][c])
+          {
+             fail[trie[0][c]] = 0;
+             queue[tail++] = trie[0][c];
+          }
+     }
+   while (head < tail)
+     {
+        int s = queue[head++];
+
+        if (_ac_match[s] < 0) _ac_match[s] = _ac_match[fail[s]];
+        for (c = 0; c < 128; c++)
           {
-             char end = s[len - 1];
-             if (len - prev_len == 2 && len >= 2)
-               end = s[len - 2];
+             int u = trie[s][c];
 
-             if ((end == endmatch) ||
-                 ((!escaped) && (isspace(end)) &&
-                  ((end != '\n') || (end != '\r'))))
+             if (u)
                {
-                  goforward = EINA_FALSE;
-                  coord_back(&x2, &y2, w, h);
-                  endmatch = 0;
+                  fail[u] = _ac_next[fail[s]][c];
+                  _ac_next[s][c] = u;
+                  queue[tail++] = u;
                }
-             escaped = (end == '\\');
+             else
+               _ac_next[s][c] = _ac_next[fail[s]][c];
           }
-        if ((goback) && (!coord_back(&x1, &y1, w, h)))
+     }
+   _ac_ready = EINA_TRUE;
+}
+
+typedef struct _Termlink Termlink;
+struct _Termlink
+{
+   int x1, y1, x2, y2;
+   char *string;
+};
+
+struct _Termlinks
+{
+   int w, h, sc;
+   unsigned int gen; // bumped every frame
+   struct {
+      Eina_List *links;
+      unsigned int gen; // frame the row was last scanned in, 0 if never
+   } *rows;
+};
+
+Termlinks *
+termio_links_new(void)
+{
+   if (!_ac_ready) _ac_build();
+   return calloc(1, sizeof(Termlinks));
+}
+
+static void
+_links_del(Termlinks *tl, Termlink *lnk)
+{
+   int y;
+
+   for (y = lnk->y1; y <= lnk->y2; y++)
+     tl->rows[y].links = eina_list_remove(tl->rows[y].links, lnk);
+   free(lnk->string);
+   free(lnk);
+}
+
+static void
+_links_clear(Termlinks *tl, int y1, int y2)
+{
+   int y;
+
+   for (y = y1; y <= y2; y++)
+     {
+        while (tl->rows[y].links)
+          _links_del(tl, eina_list_data_get(tl->rows[y].links));
+        tl->rows[y].gen = 0;
+     }
+}
+
+void
+termio_links_free(Termlinks *tl)
+{
+   if (!tl) return;
+   if (tl->rows) _links_clear(tl, 0, tl->h - 1);
+   free(tl->rows);
+   free(tl);
+}
+
+void
+termio_links_frame(Termlinks *tl, int w, int h, int sc)
+{
+   if ((w != tl->w) || (h != tl->h) || (sc != tl->sc) || (!tl->rows))
+     {
+        if (tl->rows) _links_clear(tl, 0, tl->h - 1);
+        free(tl->rows);
+        tl->rows = calloc(MAX(h, 1), sizeof(tl->rows[0]));
+        tl->w = w;
+        tl->h = h;
+        tl->sc = sc;
+        if (!tl->rows) tl->h = 0;
+     }
+   tl->gen++;
+   if (!tl->gen) tl->gen++;
+}
+
+/* keep cells ts to te of the line starting at row ya as a link to s */
+static void
+_links_add(Termlinks *tl, int ya, int ts, int te, char *s)
+{
+   Termlink *lnk;
+   int y;
+
+   lnk = calloc(1, sizeof(Termlink));
+   if (!lnk)
+     {
+        free(s);
+        return;
+     }
+   lnk->x1 = ts % tl->w;
+   lnk->y1 = ya + (ts / tl->w);
+   lnk->x2 = te % tl->w;
+   lnk->y2 = ya + (te / tl->w);
+   lnk->string = s;
+   for (y = lnk->y1; y <= lnk->y2; y++)
+     tl->rows[y].links = eina_list_append(tl->rows[y].links, lnk);
+}
+
+static void
+_links_token_end(Termlinks *tl, Linkscan *ls, Evas_Object *obj,
+                 int ya, int ts, int te)
+{
+   char *s;
+
+   s = _scan_link_get(ls, obj, ts % tl->w, ya + (ts / tl->w),
+                      te % tl->w, ya + (te / tl->w));
+   if (s) _links_add(tl, ya, ts, te, s);
+}
+
+/* runs of cells in the same explicit link, added ahead of the links found
+ * in the text so they win where both are */
+static void
+_links_explicit(Termlinks *tl, Linkscan *ls, int ya, int n)
+{
+   int i, ts = 0, link = 0;
+
+   for (i = 0; i <= n; i++)
+     {
+        int l = (i < n) ? _scan_cell_link(ls, i % tl->w, ya + (i / tl->w)) : 0;
+
+        if (l == link) continue;
+        if (link)
           {
-             goback = EINA_FALSE;
-             goforward = EINA_TRUE;
+             const char *uri = termpty_hyperlink_uri_get(ls->ty, link);
+             char *s = uri ? strdup(uri) : NULL;
+
+             if (s) _links_add(tl, ya, ts, i - 1, s);
           }
-        if ((goforward) && (!coord_forward(&x2, &y2, w, h)))
+        link = l;
+        ts = i;
+     }
+}
+
+/* scan the logical line holding row y unless that was done this frame.
+ * returns the first row of the line, or -1 if nothing was scanned */
+int
+termio_links_row_update(Termlinks *tl, Evas_Object *obj, Eina_Bool damaged,
+                        int y)
+{
+   Linkscan ls;
+   const Termatt *att;
+   Eina_Unicode g;
+   int ya, yb, i, n, ts = 0, state = 0;
+   char endmatch = 0;
+   Eina_Bool in_tok = EINA_FALSE, cand = EINA_FALSE, proto = EINA_FALSE;
+   Eina_Bool escaped = EINA_FALSE;
+
+   if ((y < 0) || (y >= tl->h)) return -1;
+   if (tl->rows[y].gen == tl->gen) return -1;
+   if ((!damaged) && (tl->rows[y].gen)) return -1;
+   if (!_scan_begin(&ls, obj)) return -1;
+   if ((ls.w != tl->w) || (ls.h != tl->h))
+     {
+        _scan_end(&ls);
+        return -1;
+     }
+   for (ya = y; (ya > 0) && (_scan_row_wrapped(&ls, ya - 1)); ya--);
+   for (yb = y; _scan_row_wrapped(&ls, yb); yb++);
+   _links_clear(tl, ya, yb);
+
+   n = (yb - ya + 1) * tl->w;
+   _links_explicit(tl, &ls, ya, n);
+   for (i = 0; i <= n; i++)
+     {
+        Eina_Bool space;
+        int m;
+
+        if (i == n)
           {
-             goforward = EINA_FALSE;
+             // like hovering, a quote still open at the end of the
+             // screen is no link
+             if ((in_tok) && (cand) && ((!endmatch) || (yb < (tl->h - 1))))
+               _links_token_end(tl, &ls, obj, ya, ts, n - 1);
+             break;
           }
-        if ((!goback) && (!goforward))
+        g = _scan_cell_get(&ls, i % tl->w, ya + (i / tl->w), &att);
+        space = _scan_is_space(g, att);
+        if (in_tok)
           {
-             free(s);
-             s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc, &len);
-             break;
+             if (((endmatch) && (g == (Eina_Unicode)endmatch)) ||
+                 ((!escaped) && (space)))
+               {
+                  if (cand) _links_token_end(tl, &ls, obj, ya, ts, i - 1);
+                  in_tok = EINA_FALSE;
+                  endmatch = 0;
+                  escaped = EINA_FALSE;
+                  continue;
+               }
           }
-        free(s);
-        s = NULL;
-     }
-   if (s)
-     {
-        if ((len > 1) && (!endmatch))
+        else
           {
-             Eina_Bool is_file = _is_file(s);
-
-             if (is_file ||
-                 link_is_email(s) ||
-                 link_is_url(s))
+             if ((space) || (_scan_endmatch(g)))
                {
-                  if (x1r) *x1r = x1;
-                  if (y1r) *y1r = y1;
-                  if (x2r) *x2r = x2;
-                  if (y2r) *y2r = y2;
+                  endmatch = _scan_endmatch(g);
+                  continue;
+               }
+             in_tok = EINA_TRUE;
+             ts = i;
+             state = 0;
+             proto = EINA_FALSE;
+             // paths are only told apart by their first chars
+             cand = ((g == '/') || (g == '~') || (g == '.'));
+          }
+        state = _ac_next[state][(g < 128) ? tolower(g) : 0];
+        m = _ac_match[state];
+        if (m >= 0)
+          {
+             int start = i - strlen(_ac_patterns[m]) + 1;
 
-                  if (is_file && (s[0] != '/'))
+             if (m < AC_HOST)
+               {
+                  if (!proto)
                     {
-                       char *ret = _local_path_get(obj, s);
-                       free(s);
-                       return ret;
+                       // the link starts at the protocol
+                       proto = cand = EINA_TRUE;
+                       if (start > ts)
+                         {
+                            ts = start;
+                            endmatch = _scan_endmatch
+                              (_scan_cell_get(&ls, (start - 1) % tl->w,
+                                              ya + ((start - 1) / tl->w),
+                                              &att));
+                         }
                     }
-
-                  return s;
                }
+             else if ((m == AC_AT) || (start == ts))
+               cand = EINA_TRUE;
+          }
+        escaped = (g == '\\');
+     }
+   for (i = ya; i <= yb; i++)
+     tl->rows[i].gen = tl->gen;
+   _scan_end(&ls);
+   return ya;
+}
+
+/* sets mask[x] for the cells of row y that are in a link */
+void
+termio_links_row_mask(const Termlinks *tl, int y, unsigned char *mask)
+{
+   const Termlink *lnk;
+   const Eina_List *l;
+
+   memset(mask, 0, tl->w);
+   if ((y < 0) || (y >= tl->h)) return;
+   EINA_LIST_FOREACH(tl->rows[y].links, l, lnk)
+     {
+        int x1 = (lnk->y1 == y) ? lnk->x1 : 0;
+        int x2 = (lnk->y2 == y) ? lnk->x2 : tl->w - 1;
+
+        if (x2 >= x1) memset(mask + x1, 1, x2 - x1 + 1);
+     }
+}
+
+/* the link under x,y, if any. a copy of its text is returned */
+char *
+termio_links_at(const Termlinks *tl, int x, int y,
+                int *x1r, int *y1r, int *x2r, int *y2r)
+{
+   const Termlink *lnk;
+   const Eina_List *l;
+
+   if ((y < 0) || (y >= tl->h)) return NULL;
+   EINA_LIST_FOREACH(tl->rows[y].links, l, lnk)
+     {
+        if (((lnk->y1 < y) || (x >= lnk->x1)) &&
+            ((lnk->y2 > y) || (x <= lnk->x2)))
+          {
+             if (x1r) *x1r = lnk->x1;
+             if (y1r) *y1r = lnk->y1;
+             if (x2r) *x2r = lnk->x2;
+             if (y2r) *y2r = lnk->y2;
+             return strdup(lnk->string);
           }
-        free(s);
      }
    return NULL;
 }
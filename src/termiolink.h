@@ -1,6 +1,15 @@
 #ifndef _TERMIO_LINK_H__
 #define _TERMIO_LINK_H__ 1
 
+typedef struct _Termlinks Termlinks;
+
 char *_termio_link_find(Evas_Object *obj, int cx, int cy, int *x1r, int *y1r, int *x2r, int *y2r);
 
+Termlinks *termio_links_new(void);
+void termio_links_free(Termlinks *tl);
+void termio_links_frame(Termlinks *tl, int w, int h, int sc);
+int termio_links_row_update(Termlinks *tl, Evas_Object *obj, Eina_Bool damaged, int y);
+void termio_links_row_mask(const Termlinks *tl, int y, unsigned char *mask);
+char *termio_links_at(const Termlinks *tl, int x, int y, int *x1r, int *y1r, int *x2r, int *y2r);
+
 #endif
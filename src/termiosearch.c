@@ -0,0 +1,910 @@
+#include "private.h"
+
+#include <Elementary.h>
+#include <regex.h>
+#include "termio.h"
+#include "termpty.h"
+#include "termiosearch.h"
+#include "termptyindex.h"
+#include "utf8.h"
+
+/* seconds of history searched per idler call */
+#define SEARCH_SLICE 0.004
+/* bytes of history text handed to the regex thread at once */
+#define SEARCH_JOB_BYTES (256 * 1024)
+/* matches the regex thread sends back at once */
+#define SEARCH_JOB_FOUND 256
+
+/* the screen is searched again on every frame, history once in idle time
+ * going up from the screen. matches are kept by row number (see
+ * backsaved in Termpty) so they stay put while output scrolls them away.
+ *
+ * a regex is too slow to run over history in the main loop, there the
+ * idler only copies lines out as utf8 and a thread runs the regex over
+ * the copy, sending matches back as it goes */
+
+typedef struct _Termmatch Termmatch;
+struct _Termmatch
+{
+   long long row; /* row of the first cell */
+   int x, len; /* len in cells, may go on in the rows below */
+};
+
+typedef struct _Termfound Termfound;
+struct _Termfound
+{
+   Termmatch *m;
+   int num, size;
+};
+
+typedef struct _Termregex Termregex;
+struct _Termregex
+{
+   regex_t re;
+   int ref; /* the search and each job using it */
+};
+
+typedef struct _Termline Termline;
+struct _Termline
+{
+   long long row; /* row the line starts at */
+   int off, len; /* bytes in text, nul terminated */
+};
+
+typedef struct _Termjob Termjob;
+struct _Termjob
+{
+   Termsearch *se; /* NULL once the search has let go of the job */
+   Termregex *re;
+   Ecore_Thread *thread;
+   int w;
+   char *text;
+   int *pos; /* cell of each byte of text, from the start of its line */
+   int used, size;
+   Termline *lines;
+   int num, lines_size;
+};
+
+struct _Termsearch
+{
+   Termpty *ty;
+   const char *str;
+   Termregex *re; /* set for a regex search, else pat is */
+   Termjob *job; /* history being searched by the thread, if any */
+   Termjob screen; /* never threaded, the screen goes through it */
+   Termfound found;
+   Eina_Unicode *pat;
+   int plen;
+   Eina_Bool fold; /* no uppercase in the pattern, ignore case */
+   int shift[256];
+   Termmatch *m;
+   int num, size;
+   int maxlen; /* longest match */
+   Eina_Bool sorted;
+   Ecore_Idler *idler;
+   long long hist_next; /* lines ending here and above are still to do */
+   /* with a history index only lines starting at cand rows need a look
+    * between cand_from and cand_to, cand_num of them are left */
+   long long *cand;
+   int cand_num;
+   long long cand_from, cand_to;
+   Eina_Bool indexed;
+   long long gap_lo, gap_hi; /* rows scrolled by unseen, empty if lo > hi */
+   long long screen_from, screen_to; /* rows searched for the last frame */
+   unsigned int backgen;
+   int w;
+   Eina_Bool have_cur;
+   long long cur_row;
+   int cur_x;
+   void (*cb)(void *data);
+   const void *data;
+   /* scratch for one line, its chars and the cell each char is at */
+   Eina_Unicode *line;
+   int *pos;
+   int line_size;
+   Termrow view;
+};
+
+static inline Eina_Unicode
+_fold(Eina_Unicode g, Eina_Bool fold)
+{
+   if ((fold) && (g >= 'A') && (g <= 'Z')) return g + ('a' - 'A');
+   return g;
+}
+
+static Eina_Bool
+_line_grow(Termsearch *se, int size)
+{
+   Eina_Unicode *line;
+   int *pos;
+
+   if (size <= se->line_size) return EINA_TRUE;
+   size = ((size + 255) / 256) * 256;
+   line = realloc(se->line, size * sizeof(Eina_Unicode));
+   if (!line) return EINA_FALSE;
+   se->line = line;
+   pos = realloc(se->pos, size * sizeof(int));
+   if (!pos) return EINA_FALSE;
+   se->pos = pos;
+   se->line_size = size;
+   return EINA_TRUE;
+}
+
+/* cells of row y, from a view when possible so history stays packed */
+static int
+_row_get(Termsearch *se, int y, const Eina_Unicode **cps, const Termcell **cells)
+{
+   int w = 0;
+
+   *cps = NULL;
+   *cells = NULL;
+   if (termpty_row_view_get(se->ty, y, &se->view))
+     {
+        *cps = se->view.codepoints;
+        return se->view.w;
+     }
+   *cells = termpty_cellrow_get(se->ty, y, &w);
+   if (!*cells) return 0;
+   return w;
+}
+
+static inline const Termatt *
+_row_att(const Termsearch *se, const Termcell *cells, int x)
+{
+   if (cells) return &(cells[x].att);
+   return &(se->view.pal[se->view.idx[x]].att);
+}
+
+static Eina_Bool
+_row_wrapped(Termsearch *se, int y)
+{
+   const Eina_Unicode *cps;
+   const Termcell *cells;
+   int w;
+
+   if ((y < -se->ty->backscroll_num) || (y >= (se->ty->h - 1)))
+     return EINA_FALSE;
+   w = _row_get(se, y, &cps, &cells);
+   if (w <= 0) return EINA_FALSE;
+   return _row_att(se, cells, w - 1)->autowrapped;
+}
+
+static int
+_line_start(Termsearch *se, int y)
+{
+   while ((y > -se->ty->backscroll_num) && (_row_wrapped(se, y - 1))) y--;
+   return y;
+}
+
+static int
+_line_end(Termsearch *se, int y)
+{
+   while (_row_wrapped(se, y)) y++;
+   return y;
+}
+
+static Eina_Bool
+_matches_add(Termmatch **pm, int *num, int *size, long long row, int x, int len)
+{
+   if (*num >= *size)
+     {
+        Termmatch *m;
+        int sz = *size ? *size * 2 : 64;
+
+        m = realloc(*pm, sz * sizeof(Termmatch));
+        if (!m) return EINA_FALSE;
+        *pm = m;
+        *size = sz;
+     }
+   (*pm)[*num].row = row;
+   (*pm)[*num].x = x;
+   (*pm)[*num].len = len;
+   (*num)++;
+   return EINA_TRUE;
+}
+
+static void
+_match_add(Termsearch *se, long long row, int x, int len)
+{
+   if (!_matches_add(&(se->m), &(se->num), &(se->size), row, x, len)) return;
+   if (len > se->maxlen) se->maxlen = len;
+   se->sorted = EINA_FALSE;
+}
+
+static void
+_regex_unref(Termregex *re)
+{
+   if (!re) return;
+   re->ref--;
+   if (re->ref > 0) return;
+   regfree(&(re->re));
+   free(re);
+}
+
+static void
+_job_clear(Termjob *job)
+{
+   free(job->text);
+   free(job->pos);
+   free(job->lines);
+}
+
+static void
+_job_free(Termjob *job)
+{
+   _regex_unref(job->re);
+   _job_clear(job);
+   free(job);
+}
+
+/* copy a line out as utf8, the cells of its chars in pos */
+static Eina_Bool
+_job_line_add(Termjob *job, long long row,
+              const Eina_Unicode *line, const int *pos, int n)
+{
+   Termline *l;
+   int i, off = job->used;
+
+   if (job->num >= job->lines_size)
+     {
+        int size = job->lines_size ? job->lines_size * 2 : 64;
+
+        l = realloc(job->lines, size * sizeof(Termline));
+        if (!l) return EINA_FALSE;
+        job->lines = l;
+        job->lines_size = size;
+     }
+   // up to 6 bytes a char and the nul
+   if (job->used + (n * 6) + 8 > job->size)
+     {
+        int size = job->used + (n * 6) + 8;
+        char *text;
+        int *p;
+
+        size = ((size + 4095) / 4096) * 4096;
+        text = realloc(job->text, size);
+        if (!text) return EINA_FALSE;
+        job->text = text;
+        p = realloc(job->pos, size * sizeof(int));
+        if (!p) return EINA_FALSE;
+        job->pos = p;
+        job->size = size;
+     }
+   for (i = 0; i < n; i++)
+     {
+        int b, len = codepoint_to_utf8(line[i], job->text + job->used);
+
+        for (b = 0; b < len; b++) job->pos[job->used + b] = pos[i];
+        job->used += len;
+     }
+   job->text[job->used++] = 0;
+   l = &(job->lines[job->num++]);
+   l->row = row;
+   l->off = off;
+   l->len = job->used - off - 1;
+   return EINA_TRUE;
+}
+
+/* run the regex over line i of the job, this is what the thread does */
+static void
+_job_line_match(const Termjob *job, int i, Termfound *f)
+{
+   const Termline *l = &(job->lines[i]);
+   const char *s = job->text + l->off;
+   const int *pos = job->pos + l->off;
+   regmatch_t rm;
+   int off = 0, flags = 0;
+
+   while (off < l->len)
+     {
+        int b0, b1;
+
+        if (regexec(&(job->re->re), s + off, 1, &rm, flags)) break;
+        b0 = off + rm.rm_so;
+        b1 = off + rm.rm_eo;
+        if (b1 > b0)
+          {
+             int start = pos[b0];
+
+             if (!_matches_add(&(f->m), &(f->num), &(f->size),
+                               l->row + (start / job->w), start % job->w,
+                               pos[b1 - 1] - start + 1))
+               break;
+             off = b1;
+          }
+        else
+          {
+             // step over an empty match to the next char
+             off = b0 + 1;
+             while ((off < l->len) && ((s[off] & 0xc0) == 0x80)) off++;
+          }
+        flags = REG_NOTBOL;
+     }
+}
+
+static void
+_job_found_add(Termsearch *se, const Termfound *f)
+{
+   int i;
+
+   for (i = 0; i < f->num; i++)
+     _match_add(se, f->m[i].row, f->m[i].x, f->m[i].len);
+}
+
+/* horspool over the chars of the line, shifts are looked up by the low
+ * byte of the char so distinct chars sharing one just shift less */
+static void
+_line_match(Termsearch *se, int ya, int n)
+{
+   const Eina_Unicode *t = se->line, *p = se->pat;
+   int m = se->plen, i = 0, j;
+
+   while (i <= n - m)
+     {
+        Eina_Unicode last = _fold(t[i + m - 1], se->fold);
+
+        if (last == p[m - 1])
+          {
+             for (j = m - 2; j >= 0; j--)
+               {
+                  if (_fold(t[i + j], se->fold) != p[j]) break;
+               }
+             if (j < 0)
+               {
+                  int start = se->pos[i];
+
+                  _match_add(se, se->ty->backsaved + ya + (start / se->w),
+                             start % se->w, se->pos[i + m - 1] - start + 1);
+                  i += m;
+                  continue;
+               }
+          }
+        i += se->shift[last & 0xff];
+     }
+}
+
+static void
+_line_search(Termsearch *se, int ya, int yb, Termjob *job)
+{
+   int y, x, n = 0;
+
+   for (y = ya; y <= yb; y++)
+     {
+        const Eina_Unicode *cps;
+        const Termcell *cells;
+        int w = _row_get(se, y, &cps, &cells);
+
+        if (w > se->w) w = se->w;
+        if (!_line_grow(se, n + w)) return;
+        for (x = 0; x < w; x++)
+          {
+             Eina_Unicode g = cells ? cells[x].codepoint : cps[x];
+
+#if defined(SUPPORT_DBLWIDTH)
+             if ((g == 0) && (_row_att(se, cells, x)->dblwidth)) continue;
+#endif
+             se->line[n] = g ? g : ' ';
+             se->pos[n] = ((y - ya) * se->w) + x;
+             n++;
+          }
+     }
+   if (!se->re)
+     {
+        if (n >= se->plen) _line_match(se, ya, n);
+     }
+   else if (n > 0)
+     {
+        if (job)
+          {
+             _job_line_add(job, se->ty->backsaved + ya, se->line, se->pos, n);
+             return;
+          }
+        job = &(se->screen);
+        job->used = job->num = 0;
+        if (!_job_line_add(job, se->ty->backsaved + ya,
+                           se->line, se->pos, n))
+          return;
+        se->found.num = 0;
+        _job_line_match(job, 0, &(se->found));
+        _job_found_add(se, &(se->found));
+     }
+}
+
+/* search the line ending at row y, returns the row it starts at */
+static int
+_search_up(Termsearch *se, int y, Termjob *job)
+{
+   int ya = _line_start(se, y);
+
+   _line_search(se, ya, y, job);
+   return ya;
+}
+
+static void
+_job_run(void *data, Ecore_Thread *thread)
+{
+   Termjob *job = data;
+   Termfound *f = NULL;
+   int i;
+
+   for (i = 0; i < job->num; i++)
+     {
+        if (ecore_thread_check(thread)) break;
+        if (!f) f = calloc(1, sizeof(Termfound));
+        if (!f) break;
+        _job_line_match(job, i, f);
+        if (f->num >= SEARCH_JOB_FOUND)
+          {
+             if (!ecore_thread_feedback(thread, f))
+               {
+                  free(f->m);
+                  free(f);
+               }
+             f = NULL;
+          }
+     }
+   if (!f) return;
+   if ((f->num == 0) || (ecore_thread_check(thread)) ||
+       (!ecore_thread_feedback(thread, f)))
+     {
+        free(f->m);
+        free(f);
+     }
+}
+
+static void
+_job_notify(void *data, Ecore_Thread *thread EINA_UNUSED, void *msg)
+{
+   Termjob *job = data;
+   Termfound *f = msg;
+   Termsearch *se = job->se;
+
+   if ((se) && (f->num > 0))
+     {
+        _job_found_add(se, f);
+        if (se->cb) se->cb((void *)se->data);
+     }
+   free(f->m);
+   free(f);
+}
+
+static Eina_Bool _cb_idle(void *data);
+
+/* called for a finished job as well as a cancelled one */
+static void
+_job_end(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Termjob *job = data;
+   Termsearch *se = job->se;
+
+   if (se)
+     {
+        se->job = NULL;
+        // carry on with the rest of history
+        if (!se->idler) se->idler = ecore_idler_add(_cb_idle, se);
+     }
+   _job_free(job);
+}
+
+static void
+_job_drop(Termsearch *se)
+{
+   if (!se->job) return;
+   se->job->se = NULL;
+   ecore_thread_cancel(se->job->thread);
+   se->job = NULL;
+}
+
+/* hand the lines copied so far to a thread, false if there were none */
+static Eina_Bool
+_job_start(Termsearch *se, Termjob *job)
+{
+   Ecore_Thread *thread;
+
+   if (job->num == 0)
+     {
+        _job_free(job);
+        return EINA_FALSE;
+     }
+   se->job = job;
+   thread = ecore_thread_feedback_run(_job_run, _job_notify, _job_end,
+                                      _job_end, job, EINA_FALSE);
+   // on failure the job has been ended already
+   if (thread) job->thread = thread;
+   return EINA_TRUE;
+}
+
+static Termjob *
+_job_new(Termsearch *se)
+{
+   Termjob *job = calloc(1, sizeof(Termjob));
+
+   if (!job) return NULL;
+   job->se = se;
+   job->re = se->re;
+   job->re->ref++;
+   job->w = se->w;
+   return job;
+}
+
+static void
+_search_screen(Termsearch *se)
+{
+   Termpty *ty = se->ty;
+   long long top, bottom;
+   int y, yb, i, n;
+
+   y = _line_start(se, 0);
+   top = ty->backsaved + y;
+   bottom = ty->backsaved + ty->h - 1;
+   // rows that scrolled by between two frames are left to the idler
+   if ((se->screen_to >= se->screen_from) && (top > se->screen_to + 1))
+     {
+        if (se->gap_lo > se->gap_hi) se->gap_lo = se->screen_to + 1;
+        se->gap_hi = top - 1;
+        if ((!se->idler) && (!se->job))
+          se->idler = ecore_idler_add(_cb_idle, se);
+     }
+   for (i = 0, n = 0; i < se->num; i++)
+     {
+        if (se->m[i].row < top) se->m[n++] = se->m[i];
+     }
+   if (n != se->num) se->sorted = EINA_FALSE;
+   se->num = n;
+   for (; y < ty->h; y = yb + 1)
+     {
+        yb = _line_end(se, y);
+        _line_search(se, y, yb, NULL);
+     }
+   se->screen_from = top;
+   se->screen_to = bottom;
+}
+
+static Eina_Bool
+_cb_idle(void *data)
+{
+   Termsearch *se = data;
+   Termpty *ty = se->ty;
+   Termjob *job = NULL;
+   double t0 = ecore_time_get();
+   int num = se->num;
+
+   if (se->re)
+     {
+        job = _job_new(se);
+        if (!job) return ECORE_CALLBACK_RENEW;
+     }
+   termpty_cellcomp_freeze(ty);
+   do
+     {
+        long long *next, lo;
+        int y;
+
+        if (se->gap_lo <= se->gap_hi)
+          {
+             next = &(se->gap_hi);
+             lo = se->gap_lo;
+          }
+        else
+          {
+             next = &(se->hist_next);
+             lo = ty->backsaved - ty->backscroll_num;
+          }
+        if ((next == &(se->hist_next)) && (se->indexed) &&
+            (*next >= se->cand_from) && (*next < se->cand_to))
+          {
+             long long row;
+
+             while ((se->cand_num > 0) && (se->cand[se->cand_num - 1] > *next))
+               se->cand_num--;
+             if (se->cand_num == 0)
+               {
+                  *next = se->cand_from - 1;
+                  continue;
+               }
+             row = se->cand[--se->cand_num];
+             y = row - ty->backsaved;
+             if (y >= -ty->backscroll_num)
+               _line_search(se, y, _line_end(se, y), job);
+             *next = row - 1;
+             continue;
+          }
+        y = *next - ty->backsaved;
+        if ((*next < lo) || (y < -ty->backscroll_num))
+          {
+             if (next == &(se->gap_hi))
+               {
+                  se->gap_lo = 1;
+                  se->gap_hi = 0;
+                  continue;
+               }
+             termpty_cellcomp_thaw(ty);
+             se->idler = NULL;
+             // the job ending brings the idler back to finish off
+             if ((job) && (_job_start(se, job)))
+               return ECORE_CALLBACK_CANCEL;
+             if (se->cb) se->cb((void *)se->data);
+             return ECORE_CALLBACK_CANCEL;
+          }
+        *next = ty->backsaved + _search_up(se, y, job) - 1;
+     }
+   while (((ecore_time_get() - t0) < SEARCH_SLICE) &&
+          ((!job) || (job->used < SEARCH_JOB_BYTES)));
+   termpty_cellcomp_thaw(ty);
+   if (job)
+     {
+        Ecore_Idler *idler = se->idler;
+
+        // a thread that fails to start ends the job right away, which
+        // adds an idler of its own
+        se->idler = NULL;
+        if (_job_start(se, job)) return ECORE_CALLBACK_CANCEL;
+        se->idler = idler;
+     }
+   if ((se->num != num) && (se->cb)) se->cb((void *)se->data);
+   return ECORE_CALLBACK_RENEW;
+}
+
+static void
+_restart(Termsearch *se)
+{
+   _job_drop(se);
+   se->num = 0;
+   se->maxlen = 0;
+   se->sorted = EINA_TRUE;
+   se->have_cur = EINA_FALSE;
+   se->backgen = se->ty->backgen;
+   se->w = se->ty->w;
+   se->screen.w = se->w;
+   se->gap_lo = 1;
+   se->gap_hi = 0;
+   se->screen_from = 1;
+   se->screen_to = 0;
+   _search_screen(se);
+   se->hist_next = se->screen_from - 1;
+   free(se->cand);
+   se->cand = NULL;
+   se->cand_num = 0;
+   se->indexed = (!se->re) &&
+     (termpty_index_find(se->ty, se->str, &(se->cand), &(se->cand_num),
+                         &(se->cand_from), &(se->cand_to)));
+   if (!se->idler) se->idler = ecore_idler_add(_cb_idle, se);
+}
+
+static Termregex *
+_regex_new(const char *str)
+{
+   Termregex *re;
+   int flags = REG_EXTENDED | REG_NEWLINE | REG_ICASE, err;
+   const char *p;
+
+   for (p = str; *p; p++)
+     {
+        if ((*p >= 'A') && (*p <= 'Z')) flags &= ~REG_ICASE;
+     }
+   re = calloc(1, sizeof(Termregex));
+   if (!re) return NULL;
+   err = regcomp(&(re->re), str, flags);
+   if (err)
+     {
+        char buf[256];
+
+        regerror(err, &(re->re), buf, sizeof(buf));
+        DBG("regex '%s': %s", str, buf);
+        free(re);
+        return NULL;
+     }
+   re->ref = 1;
+   return re;
+}
+
+Termsearch *
+termio_search_new(Termpty *ty, const char *str, Eina_Bool regex,
+                  void (*cb)(void *data), const void *data)
+{
+   Termsearch *se;
+   int i, len = 0;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, NULL);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(str, NULL);
+   if ((!str[0]) || (ty->w <= 0)) return NULL;
+   se = calloc(1, sizeof(Termsearch));
+   if (!se) return NULL;
+   if (regex)
+     {
+        se->re = _regex_new(str);
+        if (!se->re)
+          {
+             free(se);
+             return NULL;
+          }
+        se->screen.re = se->re;
+     }
+   else
+     {
+        se->pat = eina_unicode_utf8_to_unicode(str, &len);
+        if ((!se->pat) || (len <= 0))
+          {
+             free(se->pat);
+             free(se);
+             return NULL;
+          }
+     }
+   se->ty = ty;
+   se->str = eina_stringshare_add(str);
+   se->plen = len;
+   se->fold = EINA_TRUE;
+   for (i = 0; i < len; i++)
+     {
+        if ((se->pat[i] >= 'A') && (se->pat[i] <= 'Z')) se->fold = EINA_FALSE;
+     }
+   for (i = 0; i < 256; i++) se->shift[i] = len;
+   for (i = 0; i < len - 1; i++)
+     se->shift[se->pat[i] & 0xff] = len - 1 - i;
+   se->cb = cb;
+   se->data = data;
+   termpty_cellcomp_freeze(ty);
+   _restart(se);
+   termpty_cellcomp_thaw(ty);
+   return se;
+}
+
+void
+termio_search_free(Termsearch *se)
+{
+   if (!se) return;
+   if (se->idler) ecore_idler_del(se->idler);
+   _job_drop(se);
+   _job_clear(&(se->screen));
+   _regex_unref(se->re);
+   free(se->found.m);
+   free(se->cand);
+   termpty_row_view_free(&(se->view));
+   eina_stringshare_del(se->str);
+   free(se->pat);
+   free(se->m);
+   free(se->line);
+   free(se->pos);
+   free(se);
+}
+
+const char *
+termio_search_string_get(const Termsearch *se)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(se, NULL);
+   return se->str;
+}
+
+Eina_Bool
+termio_search_regex_get(const Termsearch *se)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(se, EINA_FALSE);
+   return !!se->re;
+}
+
+/* to be called before drawing, catches up with the screen */
+void
+termio_search_frame(Termsearch *se)
+{
+   EINA_SAFETY_ON_NULL_RETURN(se);
+   if ((se->ty->backgen != se->backgen) || (se->ty->w != se->w))
+     _restart(se);
+   else
+     _search_screen(se);
+}
+
+static int
+_match_cmp(const void *a, const void *b)
+{
+   const Termmatch *m1 = a, *m2 = b;
+
+   if (m1->row != m2->row) return (m1->row < m2->row) ? -1 : 1;
+   return m1->x - m2->x;
+}
+
+static void
+_sort(Termsearch *se)
+{
+   int i, n;
+
+   if (se->sorted) return;
+   qsort(se->m, se->num, sizeof(Termmatch), _match_cmp);
+   // rows next to a gap can be searched twice
+   for (i = 1, n = (se->num > 0); i < se->num; i++)
+     {
+        if (_match_cmp(&(se->m[n - 1]), &(se->m[i]))) se->m[n++] = se->m[i];
+     }
+   se->num = n;
+   se->sorted = EINA_TRUE;
+}
+
+/* first match at or after row, x */
+static int
+_lower_bound(const Termsearch *se, long long row, int x)
+{
+   Termmatch key = { row, x, 0 };
+   int lo = 0, hi = se->num;
+
+   while (lo < hi)
+     {
+        int mid = (lo + hi) / 2;
+
+        if (_match_cmp(&(se->m[mid]), &key) < 0) lo = mid + 1;
+        else hi = mid;
+     }
+   return lo;
+}
+
+/* mask[x] is 1 for cells of row y in a match, 2 in the selected one */
+Eina_Bool
+termio_search_row_mask(Termsearch *se, int y, int w, unsigned char *mask)
+{
+   long long row;
+   Eina_Bool any = EINA_FALSE;
+   int i;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(se, EINA_FALSE);
+   if (se->num == 0) return EINA_FALSE;
+   _sort(se);
+   row = se->ty->backsaved + y;
+   memset(mask, 0, w);
+   i = _lower_bound(se, row - ((se->maxlen / se->w) + 1), 0);
+   for (; (i < se->num) && (se->m[i].row <= row); i++)
+     {
+        const Termmatch *m = &(se->m[i]);
+        long long start = ((m->row - row) * se->w) + m->x;
+        long long end = start + m->len;
+        unsigned char v = 1;
+
+        if ((end <= 0) || (start >= w)) continue;
+        if ((se->have_cur) && (m->row == se->cur_row) && (m->x == se->cur_x))
+          v = 2;
+        if (start < 0) start = 0;
+        if (end > w) end = w;
+        memset(mask + start, v, end - start);
+        any = EINA_TRUE;
+     }
+   return any;
+}
+
+/* select the match before or after the selected one, or when none is the
+ * closest one at or above row y_from, or at or below it */
+Eina_Bool
+termio_search_select(Termsearch *se, Eina_Bool older, int y_from, int *y)
+{
+   int i;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(se, EINA_FALSE);
+   if (se->num == 0) return EINA_FALSE;
+   _sort(se);
+   if (se->have_cur)
+     {
+        i = _lower_bound(se, se->cur_row, se->cur_x);
+        if (older) i--;
+        else if ((i < se->num) && (se->m[i].row == se->cur_row) &&
+                 (se->m[i].x == se->cur_x))
+          i++;
+     }
+   else
+     {
+        long long row = se->ty->backsaved + y_from;
+
+        if (older) i = _lower_bound(se, row + 1, 0) - 1;
+        else i = _lower_bound(se, row, 0);
+     }
+   if ((i < 0) || (i >= se->num)) return EINA_FALSE;
+   se->have_cur = EINA_TRUE;
+   se->cur_row = se->m[i].row;
+   se->cur_x = se->m[i].x;
+   if (y) *y = se->cur_row - se->ty->backsaved;
+   return EINA_TRUE;
+}
+
+Eina_Bool
+termio_search_selected_get(const Termsearch *se, int *y)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(se, EINA_FALSE);
+   if (!se->have_cur) return EINA_FALSE;
+   if (y) *y = se->cur_row - se->ty->backsaved;
+   return EINA_TRUE;
+}
@@ -0,0 +1,16 @@
+#ifndef _TERMIO_SEARCH_H__
+#define _TERMIO_SEARCH_H__ 1
+
+typedef struct _Termsearch Termsearch;
+
+Termsearch *termio_search_new(Termpty *ty, const char *str, Eina_Bool regex,
+                              void (*cb)(void *data), const void *data);
+void termio_search_free(Termsearch *se);
+const char *termio_search_string_get(const Termsearch *se);
+Eina_Bool termio_search_regex_get(const Termsearch *se);
+void termio_search_frame(Termsearch *se);
+Eina_Bool termio_search_row_mask(Termsearch *se, int y, int w, unsigned char *mask);
+Eina_Bool termio_search_select(Termsearch *se, Eina_Bool older, int y_from, int *y);
+Eina_Bool termio_search_selected_get(const Termsearch *se, int *y);
+
+#endif
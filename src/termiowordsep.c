@@ -0,0 +1,245 @@
+#include "private.h"
+
+#include <Elementary.h>
+#include "termiowordsep.h"
+
+// http://en.wikipedia.org/wiki/Asterisk
+// http://en.wikipedia.org/wiki/Comma
+// http://en.wikipedia.org/wiki/Interpunct
+// http://en.wikipedia.org/wiki/Bracket
+static const Eina_Unicode _wordsep_default[] =
+{
+   0,
+   ' ',
+   '!',
+   '"',
+   '#',
+   '$',
+   '\'',
+   '(',
+   ')',
+   '*',
+   ',',
+   ':',
+   ';',
+   '=',
+   '?',
+   '[',
+   '\\',
+   ']',
+   '^',
+   '`',
+   '{',
+   '|',
+   '}',
+   0x00a0,
+   0x00ab,
+   0x00b7,
+   0x00bb,
+   0x0294,
+   0x02bb,
+   0x02bd,
+   0x02d0,
+   0x0312,
+   0x0313,
+   0x0314,
+   0x0315,
+   0x0326,
+   0x0387,
+   0x055d,
+   0x055e,
+   0x060c,
+   0x061f,
+   0x066d,
+   0x07fb,
+   0x1363,
+   0x1367,
+   0x14fe,
+   0x1680,
+   0x1802,
+   0x1808,
+   0x180e,
+   0x2000,
+   0x2001,
+   0x2002,
+   0x2003,
+   0x2004,
+   0x2005,
+   0x2006,
+   0x2007,
+   0x2008,
+   0x2009,
+   0x200a,
+   0x200b,
+   0x2018,
+   0x2019,
+   0x201a,
+   0x201b,
+   0x201c,
+   0x201d,
+   0x201e,
+   0x201f,
+   0x2022,
+   0x2027,
+   0x202f,
+   0x2039,
+   0x203a,
+   0x203b,
+   0x203d,
+   0x2047,
+   0x2048,
+   0x2049,
+   0x204e,
+   0x205f,
+   0x2217,
+   0x225f,
+   0x2308,
+   0x2309,
+   0x2420,
+   0x2422,
+   0x2423,
+   0x2722,
+   0x2723,
+   0x2724,
+   0x2725,
+   0x2731,
+   0x2732,
+   0x2733,
+   0x273a,
+   0x273b,
+   0x273c,
+   0x273d,
+   0x2743,
+   0x2749,
+   0x274a,
+   0x274b,
+   0x2a7b,
+   0x2a7c,
+   0x2cfa,
+   0x2e2e,
+   0x2e2e,
+   0x3000,
+   0x3001,
+   0x3008,
+   0x3009,
+   0x300a,
+   0x300b,
+   0x300c,
+   0x300c,
+   0x300d,
+   0x300d,
+   0x300e,
+   0x300f,
+   0x3010,
+   0x3011,
+   0x301d,
+   0x301e,
+   0x301f,
+   0x30fb,
+   0xa60d,
+   0xa60f,
+   0xa6f5,
+   0xfe10,
+   0xfe41,
+   0xfe42,
+   0xfe43,
+   0xfe44,
+   0xfe50,
+   0xfe51,
+   0xfe56,
+   0xfe61,
+   0xfe62,
+   0xfe63,
+   0xfeff,
+   0xff02,
+   0xff07,
+   0xff08,
+   0xff09,
+   0xff0a,
+   0xff0c,
+   0xff1b,
+   0xff1c,
+   0xff1e,
+   0xff1f,
+   0xff3b,
+   0xff3d,
+   0xff5b,
+   0xff5d,
+   0xff62,
+   0xff63,
+   0xff64,
+   0xff65,
+   0xe002a
+};
+
+static const unsigned char _empty[1][32];
+
+unsigned char _termio_wordsep_pages[0x110000 >> 8];
+const unsigned char (*_termio_wordsep_bits)[32] = _empty;
+
+static unsigned char (*_bits)[32] = NULL;
+static int _bits_num = 0;
+static const char *_seps = NULL;
+static Eina_Bool _built = EINA_FALSE;
+
+static void
+_add(Eina_Unicode g)
+{
+   unsigned char (*bits)[32];
+   unsigned int page;
+
+   if (g >= 0x110000) return;
+   page = _termio_wordsep_pages[g >> 8];
+   if (page == 0)
+     {
+        // page numbers are bytes, past that chars are left out
+        if (_bits_num >= 256) return;
+        bits = realloc(_bits, (_bits_num + 1) * sizeof(_bits[0]));
+        if (!bits) return;
+        _bits = bits;
+        memset(_bits[_bits_num], 0, sizeof(_bits[0]));
+        page = _bits_num++;
+        _termio_wordsep_pages[g >> 8] = page;
+     }
+   _bits[page][(g & 0xff) >> 3] |= 1 << (g & 7);
+}
+
+void
+termio_wordsep_set(const char *seps)
+{
+   unsigned int i;
+
+   if ((seps) && (!seps[0])) seps = NULL;
+   if ((_built) && (((!seps) && (!_seps)) ||
+                    ((seps) && (_seps) && (!strcmp(seps, _seps)))))
+     return;
+   _built = EINA_TRUE;
+   eina_stringshare_replace(&_seps, seps);
+   memset(_termio_wordsep_pages, 0, sizeof(_termio_wordsep_pages));
+   _termio_wordsep_bits = _empty;
+   free(_bits);
+   // page 0 stays empty for all pages without separators
+   _bits = calloc(1, sizeof(_bits[0]));
+   if (!_bits)
+     {
+        _bits_num = 0;
+        return;
+     }
+   _bits_num = 1;
+   _add(0);
+   _add(' ');
+   if (!seps)
+     {
+        for (i = 0; i < sizeof(_wordsep_default) / sizeof(_wordsep_default[0]);
+             i++)
+          _add(_wordsep_default[i]);
+     }
+   else
+     {
+        int idx = 0;
+
+        while (seps[idx])
+          _add(eina_unicode_utf8_next_get(seps, &idx));
+     }
+   _termio_wordsep_bits = (const unsigned char (*)[32])_bits;
+}
@@ -0,0 +1,21 @@
+#ifndef _TERMIO_WORDSEP_H__
+#define _TERMIO_WORDSEP_H__ 1
+
+/* chars a double click selection of a word stops at, a bit each kept in
+ * pages of 256 codepoints. pages without any share the empty page 0 */
+extern unsigned char _termio_wordsep_pages[0x110000 >> 8];
+extern const unsigned char (*_termio_wordsep_bits)[32];
+
+/* build the table from a utf8 string of separators, NULL for the built
+ * in ones. blanks and spaces always separate */
+void termio_wordsep_set(const char *seps);
+
+static inline Eina_Bool
+termio_wordsep_is(Eina_Unicode g)
+{
+   if (EINA_UNLIKELY(g >= 0x110000)) return !!(g & 0x80000000);
+   return (_termio_wordsep_bits[_termio_wordsep_pages[g >> 8]]
+           [(g & 0xff) >> 3] >> (g & 7)) & 1;
+}
+
+#endif
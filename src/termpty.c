@@ -4,6 +4,8 @@
 #include "termptyesc.h"
 #include "termptyops.h"
 #include "termptysave.h"
+#include "termptyindex.h"
+#include "termptylog.h"
 #include "termio.h"
 #include <sys/types.h>
 #include <signal.h>
@@ -166,6 +168,9 @@ _cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
    Eina_Unicode codepoint[4097];
    int len, i, j, k, reads;
 
+   // output stays in the pty until there is a screen to put it on
+   if (!termpty_screen_unpack(ty)) return ECORE_CALLBACK_RENEW;
+
    // read up to 64 * 4096 bytes
    for (reads = 0; reads < 64; reads++)
      {
@@ -180,7 +185,7 @@ _cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
           }
         len = read(ty->fd, rbuf, len);
         if (len <= 0) break;
-
+        if (ty->log) termpty_log_add(ty, rbuf, len);
 
         for (i = 0; i < (int)sizeof(ty->oldbuf); i++)
           ty->oldbuf[i] = 0;
@@ -286,15 +291,10 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
             "screen", ty->w, ty->h, strerror(errno));
         goto err;
      }
-   ty->screen2 = calloc(1, sizeof(Termcell) * ty->w * ty->h);
-   if (!ty->screen2)
-     {
-        ERR("Allocation of term %s %ix%i failed: %s",
-            "screen2", ty->w, ty->h, strerror(errno));
-        goto err;
-     }
+   // screen2 only comes to be once the alternate screen is used
 
    ty->circular_offset = 0;
+   ty->packed.last = ecore_loop_time_get();
 
    needs_shell = ((!cmd) ||
                   (strpbrk(cmd, " |&;<>()$`\\\"'*?#") != NULL));
@@ -486,6 +486,11 @@ termpty_free(Termpty *ty)
    Termexp *ex;
 
    termpty_save_unregister(ty);
+   termpty_index_set(ty, EINA_FALSE);
+   termpty_log_set(ty, NULL, EINA_FALSE);
+   termpty_rewrap_cancel(ty);
+   free(ty->rewrap.cells);
+   free(ty->rewrap.line);
    EINA_LIST_FREE(ty->block.expecting, ex) free(ex);
    if (ty->block.blocks) eina_hash_free(ty->block.blocks);
    if (ty->block.chid_map) eina_hash_free(ty->block.chid_map);
@@ -531,31 +536,27 @@ termpty_free(Termpty *ty)
    if (ty->hand_fd) ecore_main_fd_handler_del(ty->hand_fd);
    if (ty->prop.title) eina_stringshare_del(ty->prop.title);
    if (ty->prop.icon) eina_stringshare_del(ty->prop.icon);
-   if (ty->back)
-     {
-        int i;
-
-        for (i = 0; i < ty->backmax; i++)
-          {
-             if (ty->back[i])
-               {
-                  termpty_save_free(ty->back[i]);
-                  ty->back[i] = NULL;
-               }
-          }
-        free(ty->back);
-        ty->back = NULL;
-     }
+   termpty_back_free(&ty->back);
+   if (ty->spill) termpty_save_spill_set(ty, EINA_FALSE);
    if (ty->screen) free(ty->screen);
    if (ty->screen2) free(ty->screen2);
+   if (ty->screen2_release) ecore_timer_del(ty->screen2_release);
+   free(ty->packed.screen);
+   free(ty->packed.screen2);
+   free(ty->rgb.colors);
+   while (ty->hyperlink.num > 0)
+     eina_stringshare_del(ty->hyperlink.uris[--ty->hyperlink.num]);
+   free(ty->hyperlink.uris);
+   if (ty->hyperlink.ids) eina_hash_free(ty->hyperlink.ids);
    if (ty->buf) free(ty->buf);
    memset(ty, 0, sizeof(Termpty));
    free(ty);
 }
 
 void
-termpty_cellcomp_freeze(Termpty *ty EINA_UNUSED)
+termpty_cellcomp_freeze(Termpty *ty)
 {
+   if (ty) termpty_screen_unpack(ty);
    termpty_save_freeze();
 }
 
@@ -595,37 +596,125 @@ termpty_row_length(Termpty *ty, int y)
              ERR("invalid row given");
              return 0;
           }
+        if (!termpty_screen_unpack(ty)) return 0;
         cells = &(TERMPTY_SCREEN(ty, 0, y));
         return termpty_line_length(cells, ty->w);
      }
-   if ((y < -ty->backmax) || !ty->back)
+   if ((y < -ty->backmax) || !ty->back.chunks)
      {
         ERR("invalid row given");
         return 0;
      }
-   ts = ty->back[(ty->backmax + ty->backpos + y) % ty->backmax];
+   ts = termpty_back_get(&ty->back, (ty->backmax + ty->backpos + y) % ty->backmax);
    if (!ts) return 0;
 
    return ts->comp ? ((Termsavecomp*)ts)->wout : ts->w;
 }
 
+/* like termpty_cellrow_get() but leaves history as it is stored. fails
+ * for rows outside the screen and history, and for the rare row that
+ * uses more attributes than a palette holds */
+Eina_Bool
+termpty_row_view_get(Termpty *ty, int y, Termrow *row)
+{
+   if (y >= 0)
+     {
+        if (y >= ty->h) return EINA_FALSE;
+        if (!termpty_screen_unpack(ty)) return EINA_FALSE;
+        return termpty_save_view_cells(&(TERMPTY_SCREEN(ty, 0, y)), ty->w,
+                                       row);
+     }
+   if ((y < -ty->backmax) || !ty->back.chunks) return EINA_FALSE;
+   return termpty_save_view
+     (termpty_back_get(&ty->back, (ty->backmax + ty->backpos + y) % ty->backmax),
+      row);
+}
+
+void
+termpty_row_view_free(Termrow *row)
+{
+   free(row->buf);
+   memset(row, 0, sizeof(Termrow));
+}
+
+/* same as termpty_line_length() on a view */
+int
+termpty_row_view_length(const Termrow *row)
+{
+   const Eina_Unicode *cp = row->codepoints;
+   const unsigned char *idx = row->idx;
+   unsigned char vis[256];
+   int x = row->w, i;
+
+   for (i = 0; i < row->npal; i++)
+     vis[i] = (row->pal[i].att.bg != COL_INVIS);
+   // skip blank blocks of 8 first, the inner loop has no exit so it
+   // vectorizes
+   while (x >= 8)
+     {
+        int any = 0;
+
+        for (i = 1; i <= 8; i++)
+          any |= (cp[x - i] != 0) & vis[idx[x - i]];
+        if (any) break;
+        x -= 8;
+     }
+   for (; x > 0; x--)
+     {
+        if ((cp[x - 1] != 0) && (vis[idx[x - 1]])) return x;
+     }
+   return 0;
+}
+
+/* first cell at or after from holding codepoint cp, -1 if none */
+int
+termpty_row_view_find(const Termrow *row, int from, Eina_Unicode cp)
+{
+   const Eina_Unicode *c = row->codepoints;
+   int x = from, w = row->w;
+
+   if (x < 0) x = 0;
+   for (; x + 8 <= w; x += 8)
+     {
+        int i, hit = 0;
+
+        for (i = 0; i < 8; i++)
+          hit |= (c[x + i] == cp);
+        if (hit) break;
+     }
+   for (; x < w; x++)
+     {
+        if (c[x] == cp) return x;
+     }
+   return -1;
+}
+
 Termcell *
 termpty_cellrow_get(Termpty *ty, int y, int *wret)
 {
-   Termsave *ts, **tssrc;
+   Termsave *ts, *old;
+   int pos;
 
    if (y >= 0)
      {
         if (y >= ty->h) return NULL;
+        if (!termpty_screen_unpack(ty)) return NULL;
         *wret = ty->w;
         /* fprintf(stderr, "getting: %i (%i, %i)\n", y, ty->circular_offset, ty->h); */
         return &(TERMPTY_SCREEN(ty, 0, y));
      }
-   if ((y < -ty->backmax) || !ty->back) return NULL;
-   tssrc = &(ty->back[(ty->backmax + ty->backpos + y) % ty->backmax]);
-   ts = termpty_save_extract(*tssrc);
+   if ((y < -ty->backmax) || !ty->back.chunks) return NULL;
+   pos = (ty->backmax + ty->backpos + y) % ty->backmax;
+   old = termpty_back_get(&ty->back, pos);
+   ts = termpty_save_extract(old);
    if (!ts) return NULL;
-   *tssrc = ts;
+   termpty_back_set(&ty->back, ty->backmax, pos, ts);
+   // raw again, so the compressor has to get back to it
+   if (ts != old)
+     {
+        ty->backcold = MIN(ty->backcold, ty->backsaved + y);
+        ty->backspilled = MIN(ty->backspilled, ty->backsaved + y);
+     }
    *wret = ts->w;
    return ts->cell;
 }
@@ -639,6 +728,174 @@ termpty_write(Termpty *ty, const char *input, int len)
          ty->fd, strerror(errno));
 }
 
+/* index of a 24bit color in the table of the pty, adding it if needed.
+ * -1 once the table is full */
+int
+termpty_rgb_get(Termpty *ty, int r, int g, int b)
+{
+   unsigned int col = ((r & 0xff) << 16) | ((g & 0xff) << 8) | (b & 0xff);
+   int i;
+
+   // the same color tends to be set over and over
+   if ((ty->rgb.num > 0) && (ty->rgb.colors[ty->rgb.last] == col))
+     return ty->rgb.last;
+   for (i = 0; i < ty->rgb.num; i++)
+     {
+        if (ty->rgb.colors[i] == col)
+          {
+             ty->rgb.last = i;
+             return i;
+          }
+     }
+   if (ty->rgb.num >= TERMPTY_RGB_MAX) return -1;
+   if (!ty->rgb.colors)
+     {
+        ty->rgb.colors = malloc(TERMPTY_RGB_MAX * sizeof(unsigned int));
+        if (!ty->rgb.colors) return -1;
+     }
+   ty->rgb.colors[ty->rgb.num] = col;
+   ty->rgb.last = ty->rgb.num;
+   return ty->rgb.num++;
+}
+
+static Eina_Bool
+_rgb_used(const Termcell *cells, int n)
+{
+   int i;
+
+   if (!cells) return EINA_FALSE;
+   for (i = 0; i < n; i++)
+     {
+        if ((cells[i].att.fgrgb) || (cells[i].att.bgrgb)) return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+/* start the color table over if nothing left points into it - called
+ * once history and screens got cleared */
+void
+termpty_rgb_reset(Termpty *ty)
+{
+   if (ty->rgb.num == 0) return;
+   if ((ty->backscroll_num > 0) || (ty->rewrap.num > 0)) return;
+   // packed screens cannot be looked at cheaply, so they count as used
+   if ((ty->packed.screen) || (ty->packed.screen2)) return;
+   if ((_rgb_used(ty->screen, ty->w * ty->h)) ||
+       (_rgb_used(ty->screen2, ty->w * ty->h)))
+     return;
+   if ((ty->state.att.fgrgb) || (ty->state.att.bgrgb) ||
+       (ty->save.att.fgrgb) || (ty->save.att.bgrgb) ||
+       (ty->swap.att.fgrgb) || (ty->swap.att.bgrgb))
+     return;
+   ty->rgb.num = 0;
+   ty->rgb.last = 0;
+   ty->rgb.gen++;
+}
+
+/* link number of an explicit link, interning it if needed. links with
+ * the same id and uri are one link, one without an id is the same as any
+ * other without one going to the same uri. 0 once the table is full */
+int
+termpty_hyperlink_get(Termpty *ty, const char *id, const char *uri)
+{
+   const char **uris;
+   char *key;
+   size_t len;
+   int n, size;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(uri, 0);
+   if (!id) id = "";
+   len = strlen(id) + 1 + strlen(uri) + 1;
+   key = alloca(len);
+   // the id can not hold a ';', that ends the params
+   snprintf(key, len, "%s;%s", id, uri);
+   if (!ty->hyperlink.ids)
+     {
+        ty->hyperlink.ids = eina_hash_string_superfast_new(NULL);
+        if (!ty->hyperlink.ids) return 0;
+     }
+   n = (int)(intptr_t)eina_hash_find(ty->hyperlink.ids, key);
+   if (n > 0) return n;
+   if (ty->hyperlink.num >= TERMPTY_HYPERLINK_MAX) return 0;
+   if (ty->hyperlink.num >= ty->hyperlink.size)
+     {
+        size = ty->hyperlink.size ? ty->hyperlink.size * 2 : 16;
+        uris = realloc(ty->hyperlink.uris, size * sizeof(const char *));
+        if (!uris) return 0;
+        ty->hyperlink.uris = uris;
+        ty->hyperlink.size = size;
+     }
+   n = ty->hyperlink.num + 1;
+   if (!eina_hash_add(ty->hyperlink.ids, key, (void *)(intptr_t)n)) return 0;
+   ty->hyperlink.uris[ty->hyperlink.num++] = eina_stringshare_add(uri);
+   return n;
+}
+
+const char *
+termpty_hyperlink_uri_get(const Termpty *ty, int link)
+{
+   if ((link <= 0) || (link > ty->hyperlink.num)) return NULL;
+   return ty->hyperlink.uris[link - 1];
+}
+
+/* seconds on the main screen before the alternate one is freed */
+#define SCREEN2_RELEASE_DELAY 10.0
+
+/* rows of history rewrapped right away on resize, per row of screen */
+#define REWRAP_SYNC_PAGES 4
+/* rows of history rewrapped per idler call */
+#define REWRAP_BATCH 1024
+
+static Termcell *
+_termpty_scratch_get(Termcell **buf, int *size, int w)
+{
+   if (w < 1) w = 1;
+   if (w > *size)
+     {
+        Termcell *b = realloc(*buf, w * sizeof(Termcell));
+
+        if (!b) return NULL;
+        *buf = b;
+        *size = w;
+     }
+   return *buf;
+}
+
+static int
+_termpty_line_row_len(Termpty *ty, int y, Eina_Bool last)
+{
+   if (y >= 0)
+     {
+        if (last)
+          return termpty_line_length(&TERMPTY_SCREEN(ty, 0, y), ty->w);
+        return ty->w;
+     }
+   return termpty_save_width_get
+     (termpty_back_get(&ty->back, (y + ty->backpos + ty->backmax) % ty->backmax));
+}
+
+/* history rows are looked at through a copy so whatever they are stored
+ * as (compressed, shared, spilled) stays as it is. rows saved at an
+ * older width keep their own length */
+static Termcell *
+_termpty_line_row_get(Termpty *ty, int y, int *len)
+{
+   Termsave *ts;
+   Termcell *cells;
+
+   if (y >= 0)
+     {
+        *len = ty->w;
+        return &TERMPTY_SCREEN(ty, 0, y);
+     }
+   ts = termpty_back_get(&ty->back, (y + ty->backpos + ty->backmax) % ty->backmax);
+   cells = _termpty_scratch_get(&ty->rewrap.cells, &ty->rewrap.cells_size,
+                                termpty_save_width_get(ts));
+   if (!cells) return NULL;
+   *len = termpty_save_peek(ts, cells);
+   return cells;
+}
+
 static int
 termpty_line_find_top(Termpty *ty, int y_end, int *top)
 {
@@ -656,16 +913,13 @@ termpty_line_find_top(Termpty *ty, int y_end, int *top)
      }
    while (-y_start < ty->backscroll_num)
      {
-        Termsave *ts = ty->back[(y_start + ty->backpos - 1 +
-                                 ty->backmax) % ty->backmax];
-        if (ts)
-          {
-             ts = termpty_save_extract(ts);
-          }
-        if (!ts)
+        Termcell *cells;
+        int w;
+
+        cells = _termpty_line_row_get(ty, y_start - 1, &w);
+        if (!cells)
           return -1;
-        ty->back[(y_start + ty->backpos - 1 + ty->backmax) % ty->backmax] = ts;
-        if (ts->cell[ts->w - 1].att.autowrapped)
+        if ((w > 0) && (cells[w - 1].att.autowrapped))
           y_start--;
         else
           {
@@ -679,30 +933,19 @@ termpty_line_find_top(Termpty *ty, int y_end, int *top)
 
 static int
 termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
-                    Termcell *new_screen, Termsave **new_back,
+                    Termcell *new_screen, Termback *new_back,
                     int new_w, int new_y_end, int *new_y_startp,
                     int *new_cyp)
 {
    /* variables prefixed by new_ are about the resized term being built up */
    int x, y, new_x, new_y, new_y_start;
-   int len, len_last, len_remaining, copy_width, new_ts_width;
-   Termsave *ts, *new_ts;
+   int len, len_remaining, copy_width, new_ts_width;
+   Termsave *new_ts;
    Termcell *line, *new_line = NULL;
 
-   if (y_end >= 0)
-     {
-        len_last = termpty_line_length(&TERMPTY_SCREEN(ty, 0, y_end), ty->w);
-     }
-   else
-     {
-        ts = termpty_save_extract(ty->back[(y_end + ty->backpos +
-                                            ty->backmax) % ty->backmax]);
-        if (!ts)
-          return -1;
-        ty->back[(y_end + ty->backpos + ty->backmax) % ty->backmax] = ts;
-        len_last = ts->w;
-     }
-   len_remaining = len_last + (y_end - y_start) * ty->w;
+   len_remaining = 0;
+   for (y = y_start; y <= y_end; y++)
+     len_remaining += _termpty_line_row_len(ty, y, y == y_end);
    new_y_start = new_y_end;
    if (len_remaining)
      {
@@ -711,45 +954,38 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
    else
      {
         if (new_y_start < 0)
-          new_back[new_y_start + ty->backmax] = termpty_save_new(0);
+          termpty_back_set(new_back, ty->backmax, new_y_start + ty->backmax,
+                           termpty_save_new(0));
         *new_y_startp = new_y_start;
         return 0;
      }
+   y = y_start;
+   x = 0;
    if (-new_y_start > ty->backmax)
      {
-        y_start += ((-new_y_start - ty->backmax) * new_w) / ty->w;
-        x = ((-new_y_start - ty->backmax) * new_w) % ty->w;
-        len_remaining -= (-new_y_start - ty->backmax) * new_w;
+        /* skip the start of the line that does not fit in history */
+        x = (-new_y_start - ty->backmax) * new_w;
+        len_remaining -= x;
         new_y_start = -ty->backmax;
+        while (y < y_end)
+          {
+             len = _termpty_line_row_len(ty, y, EINA_FALSE);
+             if (x < len) break;
+             x -= len;
+             y++;
+          }
      }
-   else
-     {
-        x = 0;
-     }
-   y = y_start;
    new_x = 0;
    new_y = new_y_start;
 
    while (y <= y_end)
      {
-        if (y >= 0)
-          {
-             line = &TERMPTY_SCREEN(ty, 0, y);
-          }
-        else
-          {
-             ts = termpty_save_extract(ty->back[(y + ty->backpos +
-                                                 ty->backmax) % ty->backmax]);
-             if (!ts)
-               return -1;
-             ty->back[(y + ty->backpos + ty->backmax) % ty->backmax] = ts;
-             line = ts->cell;
-          }
-        if (y == y_end)
-          len = len_last;
-        else
-          len = ty->w;
-        line[len - 1].att.autowrapped = 0;
+        line = _termpty_line_row_get(ty, y, &len);
+        if (!line)
+          return -1;
+        if ((y == y_end) && (y >= 0))
+          len = termpty_line_length(line, len);
+        if (len > 0) line[len - 1].att.autowrapped = 0;
         while (x < len)
           {
              copy_width = MIN(len - x, new_w - new_x);
@@ -766,7 +1002,12 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
                        if (!new_ts)
                          return -1;
                        new_line = new_ts->cell;
-                       new_back[new_y + ty->backmax] = new_ts;
+                       if (!termpty_back_set(new_back, ty->backmax,
+                                             new_y + ty->backmax, new_ts))
+                         {
+                            termpty_save_free(new_ts);
+                            return -1;
+                         }
                     }
                }
              if (y == ty->state.cy)
@@ -794,21 +1035,188 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
    return 0;
 }
 
+/* rewrap the newest logical line of what is left and add its rows to
+ * rewrap.rows. returns how many history rows it took */
+static int
+_termpty_rewrap_line(Termpty *ty)
+{
+   Termcell *cells, *line;
+   Termsave *ts;
+   int bottom, top, age, len, total, x, i, nrows;
+
+   bottom = ty->backscroll_num - ty->rewrap.left + 1;
+   top = bottom;
+   while (top < ty->backscroll_num)
+     {
+        cells = _termpty_line_row_get(ty, -(top + 1), &len);
+        if (!cells) return -1;
+        if ((len <= 0) || (!cells[len - 1].att.autowrapped)) break;
+        top++;
+     }
+   total = 0;
+   for (age = top; age >= bottom; age--)
+     total += _termpty_line_row_len(ty, -age, EINA_TRUE);
+   line = _termpty_scratch_get(&ty->rewrap.line, &ty->rewrap.line_size,
+                               total);
+   if (!line) return -1;
+   x = 0;
+   for (age = top; age >= bottom; age--)
+     {
+        cells = _termpty_line_row_get(ty, -age, &len);
+        if (!cells) return -1;
+        memcpy(line + x, cells, len * sizeof(Termcell));
+        x += len;
+        if (len > 0) line[x - 1].att.autowrapped = 0;
+     }
+
+   nrows = total ? (total + ty->w - 1) / ty->w : 1;
+   if (ty->rewrap.num + nrows > ty->rewrap.size)
+     {
+        int size = ty->rewrap.num + nrows + 1024;
+        Termsave **rows = realloc(ty->rewrap.rows, size * sizeof(Termsave *));
+
+        if (!rows) return -1;
+        ty->rewrap.rows = rows;
+        ty->rewrap.size = size;
+     }
+   for (i = nrows - 1; i >= 0; i--)
+     {
+        int w = MIN(ty->w, total - (i * ty->w));
+
+        ts = termpty_save_new(w);
+        if (!ts) return -1;
+        if (w > 0)
+          {
+             termpty_cell_copy(ty, line + (i * ty->w), ts->cell, w);
+             if (i < (nrows - 1)) ts->cell[w - 1].att.autowrapped = 1;
+          }
+        ty->rewrap.rows[ty->rewrap.num++] = termpty_save_pack(ts);
+     }
+   len = top - bottom + 1;
+   ty->rewrap.left -= len;
+   ty->rewrap.done += len;
+   return len;
+}
+
+static void
+_termpty_rewrap_finish(Termpty *ty)
+{
+   int fresh, stale, age, i, n, pos;
+
+   stale = ty->rewrap.done + ty->rewrap.left;
+   fresh = ty->backscroll_num - stale;
+   for (age = fresh + 1; age <= ty->backscroll_num; age++)
+     {
+        pos = (ty->backpos - age + ty->backmax) % ty->backmax;
+        termpty_save_free(termpty_back_get(&ty->back, pos));
+        termpty_back_set(&ty->back, ty->backmax, pos, NULL);
+     }
+   n = 0;
+   for (i = 0; i < ty->rewrap.num; i++)
+     {
+        Termsave *ts = ty->rewrap.rows[i];
+
+        pos = (ty->backpos - (fresh + 1 + i) + ty->backmax) % ty->backmax;
+        if ((fresh + 1 + i > ty->backmax) || (n < i) ||
+            (!termpty_back_set(&ty->back, ty->backmax, pos, ts)))
+          termpty_save_free(ts);
+        else
+          n++;
+     }
+   for (age = fresh + n + 1; age <= ty->backscroll_num; age++)
+     {
+        pos = (ty->backpos - age + ty->backmax) % ty->backmax;
+        if (((pos % TERMPTY_BACK_CHUNK) == 0) || (age == ty->backscroll_num))
+          termpty_back_trim(&ty->back, pos);
+     }
+   ty->backscroll_num = fresh + n;
+   ty->backgen++;
+   free(ty->rewrap.rows);
+   ty->rewrap.rows = NULL;
+   ty->rewrap.num = ty->rewrap.size = 0;
+   ty->rewrap.left = ty->rewrap.done = 0;
+   if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
+}
+
+static Eina_Bool
+_termpty_rewrap_idler(void *data)
+{
+   Termpty *ty = data;
+   int n = 0;
+
+   while ((ty->rewrap.left > 0) && (n < REWRAP_BATCH) &&
+          (ty->rewrap.num < ty->backmax))
+     {
+        int r = _termpty_rewrap_line(ty);
+
+        if (r < 0)
+          {
+             ERR("Cannot rewrap history, leaving it as it is");
+             ty->rewrap.idler = NULL;
+             termpty_rewrap_cancel(ty);
+             return ECORE_CALLBACK_CANCEL;
+          }
+        n += r;
+     }
+   // older rows would not fit anymore
+   if ((ty->rewrap.left > 0) && (ty->rewrap.num < ty->backmax))
+     return ECORE_CALLBACK_RENEW;
+   ty->rewrap.idler = NULL;
+   _termpty_rewrap_finish(ty);
+   return ECORE_CALLBACK_CANCEL;
+}
+
+void
+termpty_rewrap_cancel(Termpty *ty)
+{
+   int i;
+
+   if (ty->rewrap.idler)
+     {
+        ecore_idler_del(ty->rewrap.idler);
+        ty->rewrap.idler = NULL;
+     }
+   for (i = 0; i < ty->rewrap.num; i++)
+     termpty_save_free(ty->rewrap.rows[i]);
+   free(ty->rewrap.rows);
+   ty->rewrap.rows = NULL;
+   ty->rewrap.num = ty->rewrap.size = 0;
+   ty->rewrap.left = ty->rewrap.done = 0;
+}
+
+void
+termpty_rewrap_drop(Termpty *ty, int n)
+{
+   // history only ever loses its oldest rows, which are the ones left
+   if (ty->rewrap.left >= n)
+     {
+        ty->rewrap.left -= n;
+        return;
+     }
+   n -= ty->rewrap.left;
+   ty->rewrap.left = 0;
+   ty->rewrap.done = MAX(ty->rewrap.done - n, 0);
+}
 
 void
 termpty_resize(Termpty *ty, int new_w, int new_h)
 {
    Termcell *new_screen = NULL;
-   Termsave **new_back = NULL;
+   Termback new_back = { NULL, 0 };
    int y_start = 0, y_end = 0, new_y_start = 0, new_y_end,
        new_cy = ty->state.cy;
-   int i, altbuf = 0;
+   int altbuf = 0, stale = 0;
 
    if ((ty->w == new_w) && (ty->h == new_h)) return;
    if ((new_w == new_h) && (new_w == 1)) return; // FIXME: something weird is
                                                  // going on at term init
+   if (!termpty_screen_unpack(ty)) return;
+   ty->backgen++;
 
    termpty_save_freeze();
+   // rows that were rewrapped for the old size are no use anymore, those
+   // not swapped in yet are still in history at whatever width they had
+   termpty_rewrap_cancel(ty);
 
    if (ty->altbuf)
      {
@@ -820,21 +1228,26 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
    if (!new_screen)
      goto bad;
    free(ty->screen2);
-   ty->screen2 = calloc(1, sizeof(Termcell) * new_w * new_h);
-   if (!ty->screen2)
-     goto bad;
-   new_back = calloc(sizeof(Termsave *), ty->backmax);
+   ty->screen2 = NULL;
+   if (altbuf)
+     {
+        ty->screen2 = calloc(1, sizeof(Termcell) * new_w * new_h);
+        if (!ty->screen2)
+          goto bad;
+        ty->circular_offset2 = 0;
+     }
 
    y_end = ty->state.cy;
    new_y_end = new_h - 1;
-   /* For each "full line" in old buffers, revrap.
-    * From most recent to oldest */
-   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax))
+   /* For each "full line" of the screen and the history right above it,
+    * revrap. From most recent to oldest */
+   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax) &&
+          (new_y_end >= -(new_h * REWRAP_SYNC_PAGES)))
      {
         if (termpty_line_find_top(ty, y_end, &y_start) < 0)
           goto bad;
         if (termpty_line_rewrap(ty, y_start, y_end,
-                                new_screen, new_back,
+                                new_screen, &new_back,
                                 new_w, new_y_end,
                                 &new_y_start, &new_cy) < 0)
           goto bad;
@@ -842,12 +1255,26 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
         y_end = y_start - 1;
         new_y_end = new_y_start - 1;
      }
+   /* older rows move over as they are, still compressed, and get
+    * rewrapped in idle time */
+   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax))
+     {
+        int pos = (y_end + ty->backpos + ty->backmax) % ty->backmax;
+        Termsave *ts = termpty_back_get(&ty->back, pos);
+
+        if (!termpty_back_set(&new_back, ty->backmax,
+                              new_y_end + ty->backmax, ts))
+          break;
+        termpty_back_set(&ty->back, ty->backmax, pos, NULL);
+        new_y_start = new_y_end;
+        y_end--;
+        new_y_end--;
+        stale++;
+     }
 
    free(ty->screen);
    ty->screen = new_screen;
-   for (i = 1; i <= ty->backscroll_num; i++)
-     termpty_save_free(ty->back[(ty->backpos - i + ty->backmax) % ty->backmax]);
-   free(ty->back);
+   termpty_back_free(&ty->back);
    ty->back = new_back;
 
    ty->w = new_w;
@@ -867,40 +1294,103 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
 
    _pty_size(ty);
 
+   if (stale > 0)
+     {
+        ty->rewrap.left = stale;
+        ty->rewrap.idler = ecore_idler_add(_termpty_rewrap_idler, ty);
+     }
+
    termpty_save_thaw();
    return;
 
 bad:
    termpty_save_thaw();
    free(new_screen);
-   free(new_back);
+   termpty_back_free(&new_back);
 
 }
 
+Eina_Bool
+termpty_back_set(Termback *back, int backmax, int i, Termsave *ts)
+{
+   Termsave **chunk;
+   int c = i / TERMPTY_BACK_CHUNK;
+
+   if (!back->chunks)
+     {
+        if (!ts) return EINA_TRUE;
+        back->num = (backmax + TERMPTY_BACK_CHUNK - 1) / TERMPTY_BACK_CHUNK;
+        back->chunks = calloc(back->num, sizeof(Termsave **));
+        if (!back->chunks)
+          {
+             back->num = 0;
+             return EINA_FALSE;
+          }
+     }
+   chunk = back->chunks[c];
+   if (!chunk)
+     {
+        if (!ts) return EINA_TRUE;
+        chunk = calloc(TERMPTY_BACK_CHUNK, sizeof(Termsave *));
+        if (!chunk) return EINA_FALSE;
+        back->chunks[c] = chunk;
+     }
+   chunk[i % TERMPTY_BACK_CHUNK] = ts;
+   return EINA_TRUE;
+}
+
 void
-termpty_backscroll_set(Termpty *ty, int size)
+termpty_back_trim(Termback *back, int i)
 {
-   int i;
+   Termsave **chunk;
+   int c = i / TERMPTY_BACK_CHUNK, j;
 
-   if (ty->backmax == size) return;
-   
-   termpty_save_freeze();
+   if (!back->chunks) return;
+   chunk = back->chunks[c];
+   if (!chunk) return;
+   for (j = 0; j < TERMPTY_BACK_CHUNK; j++)
+     {
+        if (chunk[j]) return;
+     }
+   free(chunk);
+   back->chunks[c] = NULL;
+}
 
-   if (ty->back)
+void
+termpty_back_free(Termback *back)
+{
+   int c, j;
+
+   if (!back->chunks) return;
+   for (c = 0; c < back->num; c++)
      {
-        for (i = 0; i < ty->backmax; i++)
+        Termsave **chunk = back->chunks[c];
+
+        if (!chunk) continue;
+        for (j = 0; j < TERMPTY_BACK_CHUNK; j++)
           {
-             if (ty->back[i]) termpty_save_free(ty->back[i]);
+             if (chunk[j]) termpty_save_free(chunk[j]);
           }
-        free(ty->back);
+        free(chunk);
      }
-   if (size > 0)
-     ty->back = calloc(1, sizeof(Termsave *) * size);
-   else
-     ty->back = NULL;
+   free(back->chunks);
+   back->chunks = NULL;
+   back->num = 0;
+}
+
+void
+termpty_backscroll_set(Termpty *ty, int size)
+{
+   if (ty->backmax == size) return;
+   
+   termpty_save_freeze();
+
+   termpty_rewrap_cancel(ty);
+   termpty_back_free(&ty->back);
    ty->backscroll_num = 0;
    ty->backpos = 0;
    ty->backmax = size;
+   ty->backgen++;
    termpty_save_thaw();
 }
 
@@ -1053,6 +1543,16 @@ _handle_block_codepoint_overwrite(Termpty *ty, Eina_Unicode oldc, Eina_Unicode n
    _handle_block_codepoint_overwrite_heavy(ty, oldc, newc);
 }
 
+/* cells got copied somewhere that does not go through termpty_cell_copy */
+void
+termpty_cell_ref(Termpty *ty, const Termcell *cells, int n)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+     _handle_block_codepoint_overwrite(ty, 0, cells[i].codepoint);
+}
+
 void
 termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n)
 {
@@ -1065,6 +1565,96 @@ termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n)
      }
 }
 
+static Termcell *
+_screen_unpack(void **buf, int bytes, int n)
+{
+   Termcell *cells;
+
+   cells = malloc(n * sizeof(Termcell));
+   if (!cells) return NULL;
+   if (!termpty_save_screen_unpack(*buf, bytes, cells, n))
+     {
+        ERR("Cannot unpack screen, starting from a blank one");
+        memset(cells, 0, n * sizeof(Termcell));
+     }
+   free(*buf);
+   *buf = NULL;
+   return cells;
+}
+
+Eina_Bool
+termpty_screen_unpack(Termpty *ty)
+{
+   ty->packed.last = ecore_loop_time_get();
+   if (ty->packed.screen)
+     {
+        Termcell *cells;
+
+        cells = _screen_unpack(&(ty->packed.screen), ty->packed.bytes,
+                               ty->w * ty->h);
+        if (!cells)
+          {
+             // still packed, the next one to need it tries again
+             ERR("Cannot allocate screen of %ix%i to unpack it", ty->w, ty->h);
+             return EINA_FALSE;
+          }
+        ty->screen = cells;
+     }
+   if (ty->packed.screen2)
+     {
+        ty->screen2 = _screen_unpack(&(ty->packed.screen2), ty->packed.bytes2,
+                                     ty->w * ty->h);
+        // can be made again, blank, on the next swap
+        if (!ty->screen2) ty->circular_offset2 = 0;
+     }
+   return EINA_TRUE;
+}
+
+void
+termpty_screen_pack(Termpty *ty)
+{
+   int n = ty->w * ty->h;
+
+   if ((ty->screen) && (!ty->packed.screen))
+     {
+        ty->packed.screen = termpty_save_screen_pack(ty->screen, n,
+                                                     &(ty->packed.bytes));
+        if (ty->packed.screen)
+          {
+             free(ty->screen);
+             ty->screen = NULL;
+          }
+     }
+   if ((ty->screen2) && (!ty->packed.screen2))
+     {
+        ty->packed.screen2 = termpty_save_screen_pack(ty->screen2, n,
+                                                      &(ty->packed.bytes2));
+        if (ty->packed.screen2)
+          {
+             free(ty->screen2);
+             ty->screen2 = NULL;
+          }
+     }
+}
+
+static Eina_Bool
+_screen2_cb_release(void *data)
+{
+   Termpty *ty = data;
+
+   // back on the main screen, so screen2 is the alternate screen and that
+   // is cleared when left. no point keeping a blank screen around
+   ty->screen2_release = NULL;
+   if (!ty->altbuf)
+     {
+        free(ty->screen2);
+        ty->screen2 = NULL;
+        free(ty->packed.screen2);
+        ty->packed.screen2 = NULL;
+     }
+   return EINA_FALSE;
+}
+
 void
 termpty_screen_swap(Termpty *ty)
 {
@@ -1072,6 +1662,24 @@ termpty_screen_swap(Termpty *ty)
    int tmp_circular_offset;
    int tmp_appcursor = ty->state.appcursor;
 
+   if (!termpty_screen_unpack(ty)) return;
+   if (!ty->screen2)
+     {
+        ty->screen2 = calloc(1, sizeof(Termcell) * ty->w * ty->h);
+        if (!ty->screen2)
+          {
+             ERR("Allocation of term %s %ix%i failed: %s",
+                 "screen2", ty->w, ty->h, strerror(errno));
+             return;
+          }
+        ty->circular_offset2 = 0;
+     }
+   if (ty->screen2_release)
+     {
+        ecore_timer_del(ty->screen2_release);
+        ty->screen2_release = NULL;
+     }
+
    tmp_screen = ty->screen;
    ty->screen = ty->screen2;
    ty->screen2 = tmp_screen;
@@ -1088,6 +1696,11 @@ termpty_screen_swap(Termpty *ty)
    ty->state.appcursor = tmp_appcursor;
 
    ty->altbuf = !ty->altbuf;
+   // apps tend to go in and out of the alternate screen, so let it be
+   // for a while before giving it back
+   if (!ty->altbuf)
+     ty->screen2_release = ecore_timer_add(SCREEN2_RELEASE_DELAY,
+                                           _screen2_cb_release, ty);
 
    if (ty->cb.cancel_sel.func)
      ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
@@ -9,6 +9,13 @@ typedef struct _Termatt       Termatt;
 typedef struct _Termstate     Termstate;
 typedef struct _Termsave      Termsave;
 typedef struct _Termsavecomp  Termsavecomp;
+typedef struct _Termsavespill Termsavespill;
+typedef struct _Termsavepal   Termsavepal;
+typedef struct _Termrow       Termrow;
+typedef struct _Termindex     Termindex;
+typedef struct _Termlog       Termlog;
+typedef struct _Termspill     Termspill;
+typedef struct _Termback      Termback;
 typedef struct _Termblock     Termblock;
 typedef struct _Termexp       Termexp;
 
@@ -26,6 +33,17 @@ typedef struct _Termexp       Termexp;
 #define COL_INVERSE   10
 #define COL_INVERSEBG 11
 
+/* 24bit colors used by a terminal are interned in a table of the pty and
+ * cells with fgrgb/bgrgb set keep an index into it in fg/bg. the standard
+ * textgrid palette only uses its first 96 entries so entry n of the table
+ * is shown with standard palette entry TERMPTY_RGB_BASE + n */
+#define TERMPTY_RGB_BASE 96
+#define TERMPTY_RGB_MAX  (256 - TERMPTY_RGB_BASE)
+
+/* explicit links (OSC 8) in use by a terminal are interned in a table of
+ * the pty too, cells in link n keep n in link, 0 for none */
+#define TERMPTY_HYPERLINK_MAX 0xffff
+
 #define MOUSE_OFF              0
 #define MOUSE_X10              1 // Press only
 #define MOUSE_NORMAL           2 // Press+release only
@@ -78,9 +96,13 @@ struct _Termatt
    unsigned short fraktur : 1;
 #if defined(SUPPORT_80_132_COLUMNS)
    unsigned short is_80_132_mode_allowed : 1;
-   unsigned short bit_padding : 14;
+   unsigned short fgrgb : 1;
+   unsigned short bgrgb : 1;
+   unsigned short bit_padding : 12;
 #else
-   unsigned short bit_padding : 15;
+   unsigned short fgrgb : 1;
+   unsigned short bgrgb : 1;
+   unsigned short bit_padding : 13;
 #endif
 };
 
@@ -94,6 +116,7 @@ struct _Termstate
    int           scroll_y1, scroll_y2;
    int           had_cr_x, had_cr_y;
    int           margin_top; // soon, more to come...
+   unsigned short link; // explicit link new text goes in, 0 for none
    unsigned int  multibyte : 1;
    unsigned int  alt_kp : 1;
    unsigned int  insert : 1;
@@ -110,6 +133,16 @@ struct _Termstate
    unsigned int  cjk_ambiguous_wide : 1;
 };
 
+#define TERMPTY_BACK_CHUNK 256
+
+/* history ring index - chunks of TERMPTY_BACK_CHUNK row pointers that
+ * only get allocated once rows are saved into them */
+struct _Termback
+{
+   Termsave ***chunks;
+   int num;
+};
+
 struct _Termpty
 {
    Evas_Object *obj;
@@ -125,8 +158,32 @@ struct _Termpty
       const char *title, *icon;
    } prop;
    const char *cur_cmd;
-   Termcell *screen, *screen2;
-   Termsave **back;
+   Termcell *screen, *screen2; /* screen2 is NULL until altbuf is used */
+   Ecore_Timer *screen2_release;
+   /* screens of a terminal nobody used for a while are kept lz4 packed,
+    * screen and screen2 are NULL then */
+   struct {
+      void *screen, *screen2;
+      int bytes, bytes2;
+      double last; /* loop time the screens were last needed */
+   } packed;
+   /* 24bit colors in use, 0xrrggbb, see TERMPTY_RGB_BASE. entries are
+    * not reused while any cell may still point at them, gen counts the
+    * times the table started over */
+   struct {
+      unsigned int *colors;
+      int num, last;
+      unsigned int gen;
+   } rgb;
+   /* uris of explicit links, link n is uris[n - 1]. entries are never
+    * reused as history may still point at them */
+   struct {
+      const char **uris;
+      Eina_Hash *ids; /* id param and uri to n */
+      int num, size;
+   } hyperlink;
+   Termback back;
+   Termspill *spill;
    unsigned char oldbuf[4];
    int *buf;
    int buflen;
@@ -135,7 +192,31 @@ struct _Termpty
    int circular_offset;
    int circular_offset2;
    int backmax, backpos;
+   /* rows ever scrolled into history, so backsaved + y numbers a row for as
+    * long as it is around, and a count of the times history was rewritten
+    * so such numbers went stale */
+   long long backsaved;
+   unsigned int backgen;
    int backscroll_num;
+   /* rows numbered below backcold are all cold already and those below
+    * backspilled are all out in the spill file, so the compressor leaves
+    * them alone. they only hold while backgen is still backmark_gen */
+   long long backcold, backspilled;
+   unsigned int backmark_gen;
+   /* after a resize only the screen and the rows right above it are
+    * rewrapped, older history is rewrapped in idle time into rows and
+    * swapped in once all of it is done */
+   struct {
+      Ecore_Idler *idler;
+      Termsave **rows; /* rewrapped rows, newest first */
+      Termcell *cells, *line; /* scratch for one row and one logical line */
+      int num, size;
+      int cells_size, line_size;
+      int left; /* oldest rows of history still to rewrap */
+      int done; /* rows right below those that went into rows */
+   } rewrap;
+   Termindex *index; /* trigrams of history lines, NULL unless enabled */
+   Termlog *log; /* output written to a file, NULL unless logging */
    struct {
       int curid;
       Eina_Hash *blocks;
@@ -171,25 +252,82 @@ struct _Termcell
 {
    Eina_Unicode   codepoint;
    Termatt        att;
-   unsigned char padding[2];
+   unsigned short link; // see TERMPTY_HYPERLINK_MAX
 };
 
 struct _Termsave
 {
-   unsigned int   gen  : 8;
-   unsigned int   comp : 1;
-   unsigned int   z    : 1;
-   unsigned int   w    : 22;
+   unsigned int   gen   : 7;
+   unsigned int   shared : 1;
+   unsigned int   comp  : 1;
+   unsigned int   z     : 1;
+   unsigned int   spill : 1;
+   unsigned int   cold  : 1;
+   unsigned int   pal   : 1;
+   unsigned int   w     : 19;
    Termcell       cell[1];
 };
 
 struct _Termsavecomp
 {
-   unsigned int   gen  : 8;
-   unsigned int   comp : 1;
-   unsigned int   z    : 1;
-   unsigned int   w    : 22; // compressed size in bytes
+   unsigned int   gen   : 7;
+   unsigned int   shared : 1;
+   unsigned int   comp  : 1;
+   unsigned int   z     : 1;
+   unsigned int   spill : 1;
+   unsigned int   cold  : 1; // cell bytes split in planes before lz4
+   unsigned int   pal   : 1;
+   unsigned int   w     : 19; // compressed size in bytes
+   unsigned int   wout; // output width in Termcells
+};
+
+/* uncompressed row with its attributes interned. cells only keep their
+ * codepoint and an index into a palette of the attribute bytes (att and
+ * link) used in the row. laid out after the header are npal palette
+ * entries, w codepoints and w one byte indexes */
+struct _Termsavepal
+{
+   unsigned int   gen   : 7;
+   unsigned int   shared : 1;
+   unsigned int   comp  : 1;
+   unsigned int   z     : 1;
+   unsigned int   spill : 1;
+   unsigned int   cold  : 1;
+   unsigned int   pal   : 1;
+   unsigned int   w     : 19; // width in Termcells
+   unsigned int   npal;
+};
+
+/* a row split in planes - codepoints, and for each cell an index into a
+ * palette of the attributes used in the row. for palette rows of history
+ * the planes are the saved row itself so getting one decompresses or
+ * copies nothing. the planes are plain arrays so scans over them are
+ * simple loops the compiler can vectorize. zero it before first use */
+struct _Termrow
+{
+   const Eina_Unicode *codepoints;
+   const unsigned char *idx;
+   const Termcell *pal; // only att and link of these are set
+   int w, npal;
+   void *buf; // scratch, released by termpty_row_view_free()
+   int size;
+};
+
+/* compressed row living in the pty spill file, only this stub stays
+ * in memory. comp and z are set so it reads like a Termsavecomp */
+struct _Termsavespill
+{
+   unsigned int   gen   : 7;
+   unsigned int   shared : 1;
+   unsigned int   comp  : 1;
+   unsigned int   z     : 1;
+   unsigned int   spill : 1;
+   unsigned int   cold  : 1;
+   unsigned int   pal   : 1;
+   unsigned int   w     : 19; // compressed size in bytes
    unsigned int   wout; // output width in Termcells
+   unsigned int   file; // slot of the spill file
+   unsigned int   off; // offset in the file in 16 byte units
 };
 
 struct _Termblock
@@ -236,6 +374,33 @@ ssize_t termpty_row_length(Termpty *ty, int y);
 void       termpty_write(Termpty *ty, const char *input, int len);
 void       termpty_resize(Termpty *ty, int w, int h);
 void       termpty_backscroll_set(Termpty *ty, int size);
+void       termpty_screen_pack(Termpty *ty);
+Eina_Bool  termpty_screen_unpack(Termpty *ty);
+Eina_Bool  termpty_row_view_get(Termpty *ty, int y, Termrow *row);
+void       termpty_row_view_free(Termrow *row);
+int        termpty_row_view_length(const Termrow *row);
+int        termpty_row_view_find(const Termrow *row, int from, Eina_Unicode cp);
+int        termpty_rgb_get(Termpty *ty, int r, int g, int b);
+void       termpty_rgb_reset(Termpty *ty);
+int        termpty_hyperlink_get(Termpty *ty, const char *id, const char *uri);
+const char *termpty_hyperlink_uri_get(const Termpty *ty, int link);
+void       termpty_rewrap_cancel(Termpty *ty);
+void       termpty_rewrap_drop(Termpty *ty, int n);
+
+Eina_Bool  termpty_back_set(Termback *back, int backmax, int i, Termsave *ts);
+void       termpty_back_trim(Termback *back, int i);
+void       termpty_back_free(Termback *back);
+
+static inline Termsave *
+termpty_back_get(const Termback *back, int i)
+{
+   Termsave **chunk;
+
+   if (!back->chunks) return NULL;
+   chunk = back->chunks[i / TERMPTY_BACK_CHUNK];
+   if (!chunk) return NULL;
+   return chunk[i % TERMPTY_BACK_CHUNK];
+}
 
 pid_t      termpty_pid_get(const Termpty *ty);
 void       termpty_block_free(Termblock *tb);
@@ -247,6 +412,7 @@ void       termpty_block_chid_update(Termpty *ty, Termblock *blk);
 Termblock *termpty_block_chid_get(Termpty *ty, const char *chid);
 
 void       termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n);
+void       termpty_cell_ref(Termpty *ty, const Termcell *cells, int n);
 void       termpty_cell_fill(Termpty *ty, Termcell *src, Termcell *dst, int n);
 void       termpty_cell_codepoint_att_fill(Termpty *ty, Eina_Unicode codepoint, Termatt att, Termcell *dst, int n);
 void       termpty_screen_swap(Termpty *ty);
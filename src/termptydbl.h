@@ -1,26 +1,40 @@
 #ifndef _TERMPTY_DBL_H__
 #define _TERMPTY_DBL_H__ 1
 
-Eina_Bool _termpty_is_dblwidth_slow_get(Termpty *ty, int g);
+/* width class of each codepoint, 2 bits each, see
+ * scripts/unicode_dbl_width.py which generates termptydbl.c */
+#define TERMPTY_WIDTH_NARROW    0
+#define TERMPTY_WIDTH_WIDE      1
+#define TERMPTY_WIDTH_AMBIGUOUS 2
+#define TERMPTY_WIDTH_ZERO      3
+
+extern const unsigned char _termpty_width_pages[0x110000 >> 8];
+extern const unsigned char _termpty_width_classes[];
+
+static inline int
+_termpty_width_class_get(int g)
+{
+   unsigned int page;
+
+   if (EINA_UNLIKELY((g < 0) || (g >= 0x110000)))
+     return TERMPTY_WIDTH_NARROW;
+   page = _termpty_width_pages[g >> 8];
+   return (_termpty_width_classes[(page << 6) | ((g & 0xff) >> 2)] >>
+           ((g & 3) << 1)) & 3;
+}
 
 static inline Eina_Bool
 _termpty_is_dblwidth_get(Termpty *ty, int g)
 {
 #if defined(SUPPORT_DBLWIDTH)
-   // check for east asian full-width (F), half-width (H), wide (W),
-   // narrow (Na) or ambiguous (A) codepoints
-   // ftp://ftp.unicode.org/Public/UNIDATA/EastAsianWidth.txt
+   int cls;
 
    // optimize for latin1 non-ambiguous
    if (g <= 0xa0)
      return EINA_FALSE;
-   // (F)
-   if ((g == 0x3000) ||
-       ((g >= 0xff01) && (g <= 0xff60)) ||
-       ((g >= 0xffe0) && (g <= 0xffe6)))
-     return EINA_TRUE;
-
-   return _termpty_is_dblwidth_slow_get(ty, g);
+   cls = _termpty_width_class_get(g);
+   return (cls == TERMPTY_WIDTH_WIDE) |
+     ((cls == TERMPTY_WIDTH_AMBIGUOUS) & !!ty->state.cjk_ambiguous_wide);
 #else
    return EINA_FALSE;
 #endif
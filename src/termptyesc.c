@@ -346,6 +346,82 @@ _handle_esc_csi_reset_mode(Termpty *ty, Eina_Unicode cc, Eina_Unicode *b)
      }
 }
 
+/* nearest color of the xterm 256 color cube and grey ramp */
+static int
+_color_256_get(int r, int g, int b)
+{
+   static const int steps[6] = { 0, 95, 135, 175, 215, 255 };
+   int cr, cg, cb, grey, dc, dg;
+
+#define NEAR(_v) (((_v) < 48) ? 0 : ((_v) < 115) ? 1 : (((_v) - 35) / 40))
+   cr = NEAR(r); cg = NEAR(g); cb = NEAR(b);
+#undef NEAR
+   grey = (r + g + b) / 3;
+   grey = (grey < 8) ? 0 : (grey > 238) ? 23 : ((grey - 3) / 10);
+   dc = ((r - steps[cr]) * (r - steps[cr])) +
+     ((g - steps[cg]) * (g - steps[cg])) +
+     ((b - steps[cb]) * (b - steps[cb]));
+   dg = ((r - (8 + (grey * 10))) * (r - (8 + (grey * 10)))) +
+     ((g - (8 + (grey * 10))) * (g - (8 + (grey * 10)))) +
+     ((b - (8 + (grey * 10))) * (b - (8 + (grey * 10))));
+   if (dg < dc) return 232 + grey;
+   return 16 + (36 * cr) + (6 * cg) + cb;
+}
+
+/* the r;g;b of a 38;2 or 48;2 sequence. sets *col to the index in the
+ * pty color table and returns 1, or once that is full to the nearest 256
+ * color and returns 0. -1 on a bad sequence */
+static int
+_csi_truecolor_get(Termpty *ty, Eina_Unicode **ptr, unsigned char *col)
+{
+   int r, g, b, i;
+
+   if ((*ptr) && (**ptr == ':'))
+     {
+        Eina_Unicode *p = *ptr;
+        int v[4], n = 0;
+
+        // 38:2:id:r:g:b, with the color space id mostly left empty and
+        // left out altogether by some
+        while ((*p == ':') && (n < 4))
+          {
+             p++;
+             v[n] = 0;
+             while ((*p >= '0') && (*p <= '9'))
+               {
+                  if (v[n] < 1000) v[n] = (v[n] * 10) + (*p - '0');
+                  p++;
+               }
+             n++;
+          }
+        // whatever else is in this parameter is of no use here
+        while ((*p) && (*p != ';')) p++;
+        *ptr = p;
+        if (n < 3) return -1;
+        r = v[n - 3];
+        g = v[n - 2];
+        b = v[n - 1];
+     }
+   else
+     {
+        r = _csi_arg_get(ptr);
+        if (!*ptr) return -1;
+        g = _csi_arg_get(ptr);
+        if (!*ptr) return -1;
+        b = _csi_arg_get(ptr);
+        if (!*ptr) return -1;
+     }
+   if ((r > 255) || (g > 255) || (b > 255)) return -1;
+   i = termpty_rgb_get(ty, r, g, b);
+   if (i < 0)
+     {
+        *col = _color_256_get(r, g, b);
+        return 0;
+     }
+   *col = i;
+   return 1;
+}
+
 static void
 _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
 {
@@ -441,13 +517,25 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                 case 36:
                 case 37:
                    ty->state.att.fg256 = 0;
+                   ty->state.att.fgrgb = 0;
                    ty->state.att.fg = (arg - 30) + COL_BLACK;
                    ty->state.att.fgintense = 0;
                    break;
                 case 38: // xterm 256 fg color ???
-                   // now check if next arg is 5
+                   // now check if next arg is 5, or 2 for r;g;b
                    arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+                   if (arg == 2)
+                     {
+                        int rgb = _csi_truecolor_get(ty, &b, &(ty->state.att.fg));
+
+                        if (rgb < 0) ERR("Failed xterm 24bit color fg esc val");
+                        else
+                          {
+                             ty->state.att.fg256 = !rgb;
+                             ty->state.att.fgrgb = rgb;
+                          }
+                     }
+                   else if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
@@ -456,6 +544,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                         else
                           {
                              ty->state.att.fg256 = 1;
+                             ty->state.att.fgrgb = 0;
                              ty->state.att.fg = arg;
                           }
                      }
@@ -463,6 +552,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 39: // default fg color
                    ty->state.att.fg256 = 0;
+                   ty->state.att.fgrgb = 0;
                    ty->state.att.fg = COL_DEF;
                    ty->state.att.fgintense = 0;
                    break;
@@ -475,13 +565,25 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                 case 46:
                 case 47:
                    ty->state.att.bg256 = 0;
+                   ty->state.att.bgrgb = 0;
                    ty->state.att.bg = (arg - 40) + COL_BLACK;
                    ty->state.att.bgintense = 0;
                    break;
                 case 48: // xterm 256 bg color ???
-                   // now check if next arg is 5
+                   // now check if next arg is 5, or 2 for r;g;b
                    arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+                   if (arg == 2)
+                     {
+                        int rgb = _csi_truecolor_get(ty, &b, &(ty->state.att.bg));
+
+                        if (rgb < 0) ERR("Failed xterm 24bit color bg esc val");
+                        else
+                          {
+                             ty->state.att.bg256 = !rgb;
+                             ty->state.att.bgrgb = rgb;
+                          }
+                     }
+                   else if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
@@ -490,6 +592,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                         else
                           {
                              ty->state.att.bg256 = 1;
+                             ty->state.att.bgrgb = 0;
                              ty->state.att.bg = arg;
                           }
                      }
@@ -497,6 +600,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 49: // default bg color
                    ty->state.att.bg256 = 0;
+                   ty->state.att.bgrgb = 0;
                    ty->state.att.bg = COL_DEF;
                    ty->state.att.bgintense = 0;
                    break;
@@ -509,13 +613,25 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                 case 96:
                 case 97:
                    ty->state.att.fg256 = 0;
+                   ty->state.att.fgrgb = 0;
                    ty->state.att.fg = (arg - 90) + COL_BLACK;
                    ty->state.att.fgintense = 1;
                    break;
                 case 98: // xterm 256 fg color ???
-                   // now check if next arg is 5
+                   // now check if next arg is 5, or 2 for r;g;b
                    arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
+                   if (arg == 2)
+                     {
+                        int rgb = _csi_truecolor_get(ty, &b, &(ty->state.att.fg));
+
+                        if (rgb < 0) ERR("Failed xterm 24bit color fg esc val");
+                        else
+                          {
+                             ty->state.att.fg256 = !rgb;
+                             ty->state.att.fgrgb = rgb;
+                          }
+                     }
+                   else if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
@@ -524,6 +640,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                         else
                           {
                              ty->state.att.fg256 = 1;
+                             ty->state.att.fgrgb = 0;
                              ty->state.att.fg = arg;
                           }
                      }
@@ -531,6 +648,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 99: // default fg color
                    ty->state.att.fg256 = 0;
+                   ty->state.att.fgrgb = 0;
                    ty->state.att.fg = COL_DEF;
                    ty->state.att.fgintense = 1;
                    break;
@@ -543,13 +661,25 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                 case 106:
                 case 107:
                    ty->state.att.bg256 = 0;
+                   ty->state.att.bgrgb = 0;
                    ty->state.att.bg = (arg - 100) + COL_BLACK;
                    ty->state.att.bgintense = 1;
                    break;
                 case 108: // xterm 256 bg color ???
-                   // now check if next arg is 5
+                   // now check if next arg is 5, or 2 for r;g;b
                    arg = _csi_arg_get(&b);
-                   if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
+                   if (arg == 2)
+                     {
+                        int rgb = _csi_truecolor_get(ty, &b, &(ty->state.att.bg));
+
+                        if (rgb < 0) ERR("Failed xterm 24bit color bg esc val");
+                        else
+                          {
+                             ty->state.att.bg256 = !rgb;
+                             ty->state.att.bgrgb = rgb;
+                          }
+                     }
+                   else if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
@@ -558,6 +688,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                         else
                           {
                              ty->state.att.bg256 = 1;
+                             ty->state.att.bgrgb = 0;
                              ty->state.att.bg = arg;
                           }
                      }
@@ -565,6 +696,7 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 109: // default bg color
                    ty->state.att.bg256 = 0;
+                   ty->state.att.bgrgb = 0;
                    ty->state.att.bg = COL_DEF;
                    ty->state.att.bgintense = 1;
                    break;
@@ -1178,6 +1310,33 @@ _handle_xterm_777_command(Termpty *ty EINA_UNUSED,
 #endif
 }
 
+/* OSC 8 - params;uri starts an explicit link, an empty uri ends it. params
+ * are key=value pairs split by ':', of which only id is looked at */
+static void
+_handle_xterm_8_command(Termpty *ty, char *s)
+{
+   char *uri, *p, *id = NULL;
+
+   uri = strchr(s, ';');
+   if (!uri)
+     {
+        ERR("invalid xterm hyperlink %s", s);
+        return;
+     }
+   *uri = '\0';
+   uri++;
+   if (!uri[0])
+     {
+        ty->state.link = 0;
+        return;
+     }
+   for (p = strtok(s, ":"); p; p = strtok(NULL, ":"))
+     {
+        if (!strncmp(p, "id=", 3)) id = p + 3;
+     }
+   ty->state.link = termpty_hyperlink_get(ty, id, uri);
+}
+
 static int
 _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
 {
@@ -1317,6 +1476,14 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         WRN("set palette, not supported");
         if ((cc - c) < 3) return 0;
         break;
+      case 8:
+        s = eina_unicode_unicode_to_utf8(p, &len);
+        if (s)
+          {
+             _handle_xterm_8_command(ty, s);
+             free(s);
+          }
+        break;
       case 10:
         if (!*p)
           goto err;
@@ -1567,6 +1734,7 @@ _handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         DBG("reset to init mode and clear");
         _termpty_reset_state(ty);
         _termpty_clear_screen(ty, TERMPTY_CLR_ALL);
+        termpty_rgb_reset(ty);
         if (ty->cb.cancel_sel.func)
           ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
         return 1;
@@ -1608,6 +1776,7 @@ _handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
              ty->save = ty->state;
              ty->swap = ty->state;
              _termpty_clear_screen(ty, TERMPTY_CLR_ALL);
+             termpty_rgb_reset(ty);
              if (ty->cb.cancel_sel.func)
                ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
              cells = ty->screen;
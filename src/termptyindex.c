@@ -0,0 +1,513 @@
+#include "private.h"
+
+#include <Elementary.h>
+#include "termpty.h"
+#include "termptyindex.h"
+
+/* lines of history are filed under the trigrams found in them, so a
+ * search only has to look at the lines holding every trigram of what it
+ * looks for. a line is the rows joined by autowrap, filed under the row
+ * it starts at (see backsaved in Termpty). rows are added as they go
+ * into history, after a reflow renumbered them or when turned on the
+ * index is built again from history in idle time. chars are folded to
+ * lower case and only their low bits make up a trigram, so the index
+ * narrows lines down but does not find matches by itself */
+
+/* seconds of history indexed per idler call */
+#define INDEX_SLICE 0.004
+/* guess at what the hash spends on a trigram on top of the Termgram */
+#define INDEX_GRAM_OVERHEAD 32
+
+typedef struct _Termgram Termgram;
+struct _Termgram
+{
+   unsigned int *rows; /* line starts from base, ascending */
+   int num, size;
+};
+
+struct _Termindex
+{
+   Termpty *ty;
+   Eina_Hash *grams;
+   long long base; /* row a 0 in the lists stands for */
+   long long floor; /* lines starting above here are not in the lists */
+   long long next; /* row to add next */
+   long long line; /* start of the line the last row added is part of */
+   Eina_Bool wrapped; /* the last row added goes on in the next */
+   Eina_Unicode tail[2]; /* its last chars */
+   unsigned int backgen;
+   Ecore_Idler *idler;
+   Termrow view;
+   Eina_Unicode *chars; /* scratch for one row */
+   int chars_size;
+   uint64_t postings;
+   uint64_t bytes;
+};
+
+static Eina_List *_indexes = NULL;
+static uint64_t _budget = 0;
+static uint64_t _bytes = 0;
+
+static inline Eina_Unicode
+_fold(Eina_Unicode g)
+{
+   if ((g >= 'A') && (g <= 'Z')) return g + ('a' - 'A');
+   return g;
+}
+
+static inline unsigned int
+_gram_key(Eina_Unicode a, Eina_Unicode b, Eina_Unicode c)
+{
+   return ((_fold(a) & 0x3ff) << 20) | ((_fold(b) & 0x3ff) << 10) |
+     (_fold(c) & 0x3ff);
+}
+
+static void
+_bytes_add(Termindex *ix, long long bytes)
+{
+   ix->bytes += bytes;
+   _bytes += bytes;
+}
+
+static void
+_gram_free(void *data)
+{
+   Termgram *g = data;
+
+   free(g->rows);
+   free(g);
+}
+
+static void
+_gram_add(Termindex *ix, unsigned int key, unsigned int r)
+{
+   Termgram *g = eina_hash_find(ix->grams, &key);
+
+   if (!g)
+     {
+        g = calloc(1, sizeof(Termgram));
+        if (!g) return;
+        if (!eina_hash_add(ix->grams, &key, g))
+          {
+             free(g);
+             return;
+          }
+        _bytes_add(ix, sizeof(Termgram) + INDEX_GRAM_OVERHEAD);
+     }
+   // a line only needs to be filed once under each trigram
+   if ((g->num > 0) && (g->rows[g->num - 1] == r)) return;
+   if (g->num >= g->size)
+     {
+        unsigned int *rows;
+        int size = g->size ? g->size * 2 : 4;
+
+        rows = realloc(g->rows, size * sizeof(unsigned int));
+        if (!rows) return;
+        _bytes_add(ix, (long long)(size - g->size) * sizeof(unsigned int));
+        g->rows = rows;
+        g->size = size;
+     }
+   g->rows[g->num++] = r;
+   ix->postings++;
+}
+
+/* file the n chars of row under the line they are part of */
+static void
+_row_add(Termindex *ix, long long row, const Eina_Unicode *chars, int n,
+         Eina_Bool wrapped)
+{
+   Eina_Unicode a = 0, b = 0;
+   unsigned int r;
+   int i, have = 0;
+
+   if (!ix->wrapped) ix->line = row;
+   r = ix->line - ix->base;
+   if (ix->wrapped)
+     {
+        a = ix->tail[0];
+        b = ix->tail[1];
+        have = 2;
+     }
+   for (i = 0; i < n; i++)
+     {
+        Eina_Unicode c = chars[i];
+
+        if ((have >= 2) && ((a != ' ') || (b != ' ') || (c != ' ')))
+          _gram_add(ix, _gram_key(a, b, c), r);
+        a = b;
+        b = c;
+        if (have < 2) have++;
+     }
+   ix->tail[0] = (have >= 2) ? a : ' ';
+   ix->tail[1] = (have >= 1) ? b : ' ';
+   ix->wrapped = wrapped;
+   ix->next = row + 1;
+}
+
+static Eina_Bool
+_chars_grow(Termindex *ix, int n)
+{
+   Eina_Unicode *chars;
+
+   if (n <= ix->chars_size) return EINA_TRUE;
+   n = ((n + 255) / 256) * 256;
+   chars = realloc(ix->chars, n * sizeof(Eina_Unicode));
+   if (!chars) return EINA_FALSE;
+   ix->chars = chars;
+   ix->chars_size = n;
+   return EINA_TRUE;
+}
+
+/* chars the way a search sees them, blanks as spaces and the right
+ * halves of double width chars left out */
+static inline int
+_char_put(Eina_Unicode *chars, int n, Eina_Unicode g, const Termatt *att)
+{
+#if defined(SUPPORT_DBLWIDTH)
+   if ((g == 0) && (att->dblwidth)) return n;
+#else
+   (void)att;
+#endif
+   chars[n] = g ? g : ' ';
+   return n + 1;
+}
+
+static Eina_Bool
+_gram_prune(const Eina_Hash *hash EINA_UNUSED, const void *key,
+            void *data, void *fdata)
+{
+   Termgram *g = data;
+   void **pass = fdata;
+   Termindex *ix = pass[0];
+   Eina_List **dead = pass[1];
+   unsigned int floor = ix->floor - ix->base;
+   int lo = 0, hi = g->num;
+
+   while (lo < hi)
+     {
+        int mid = (lo + hi) / 2;
+
+        if (g->rows[mid] < floor) lo = mid + 1;
+        else hi = mid;
+     }
+   if (lo == 0) return EINA_TRUE;
+   memmove(g->rows, g->rows + lo, (g->num - lo) * sizeof(unsigned int));
+   g->num -= lo;
+   ix->postings -= lo;
+   if (g->num == 0)
+     {
+        *dead = eina_list_append(*dead, key);
+        return EINA_TRUE;
+     }
+   if ((g->size > 8) && (g->num < (g->size / 4)))
+     {
+        unsigned int *rows;
+        int size = g->num * 2;
+
+        rows = realloc(g->rows, size * sizeof(unsigned int));
+        if (rows)
+          {
+             _bytes_add(ix, -(long long)(g->size - size) *
+                        sizeof(unsigned int));
+             g->rows = rows;
+             g->size = size;
+          }
+     }
+   return EINA_TRUE;
+}
+
+/* drop lines starting above floor */
+static void
+_prune(Termindex *ix, long long floor)
+{
+   Eina_List *dead = NULL;
+   void *pass[2];
+   const void *key;
+
+   if (floor <= ix->floor) return;
+   if (floor > ix->next) floor = ix->next;
+   ix->floor = floor;
+   pass[0] = ix;
+   pass[1] = &dead;
+   eina_hash_foreach(ix->grams, _gram_prune, pass);
+   // emptied trigrams can only go once the walk is over
+   EINA_LIST_FREE(dead, key)
+     {
+        Termgram *g = eina_hash_find(ix->grams, key);
+
+        if (!g) continue;
+        _bytes_add(ix, -(long long)(sizeof(Termgram) + INDEX_GRAM_OVERHEAD +
+                                    g->size * sizeof(unsigned int)));
+        eina_hash_del_by_key(ix->grams, key);
+     }
+}
+
+/* the oldest quarter of the biggest index goes until all fit again */
+static void
+_budget_enforce(void)
+{
+   while ((_budget > 0) && (_bytes > _budget))
+     {
+        Termindex *ix, *big = NULL;
+        Eina_List *l;
+
+        EINA_LIST_FOREACH(_indexes, l, ix)
+          {
+             if ((ix->next > ix->floor) &&
+                 ((!big) || (ix->bytes > big->bytes)))
+               big = ix;
+          }
+        if (!big) return;
+        _prune(big, big->floor + MAX((big->next - big->floor) / 4, 1));
+     }
+}
+
+static Eina_Bool _cb_idle(void *data);
+
+/* start over from the oldest row of history */
+static void
+_reset(Termindex *ix)
+{
+   Termpty *ty = ix->ty;
+
+   eina_hash_free_buckets(ix->grams);
+   _bytes -= ix->bytes;
+   ix->bytes = 0;
+   ix->postings = 0;
+   ix->base = ty->backsaved - ty->backscroll_num;
+   ix->floor = ix->next = ix->line = ix->base;
+   ix->wrapped = EINA_FALSE;
+   ix->backgen = ty->backgen;
+   if (!ix->idler) ix->idler = ecore_idler_add(_cb_idle, ix);
+}
+
+static Eina_Bool
+_cb_idle(void *data)
+{
+   Termindex *ix = data;
+   Termpty *ty = ix->ty;
+   double t0 = ecore_time_get();
+
+   if (ix->backgen != ty->backgen) _reset(ix);
+   termpty_cellcomp_freeze(ty);
+   while (ix->next < ty->backsaved)
+     {
+        int x, n = 0, y = ix->next - ty->backsaved;
+        Eina_Bool wrapped = EINA_FALSE;
+
+        if (y < -ty->backscroll_num)
+          {
+             // scrolled out of history before we got to it
+             ix->next = ty->backsaved - ty->backscroll_num;
+             ix->floor = MAX(ix->floor, ix->next);
+             ix->wrapped = EINA_FALSE;
+             continue;
+          }
+        if ((termpty_row_view_get(ty, y, &(ix->view))) &&
+            (_chars_grow(ix, ix->view.w)))
+          {
+             const Termrow *v = &(ix->view);
+
+             for (x = 0; x < v->w; x++)
+               n = _char_put(ix->chars, n, v->codepoints[x],
+                             &(v->pal[v->idx[x]].att));
+             if (v->w > 0) wrapped = v->pal[v->idx[v->w - 1]].att.autowrapped;
+          }
+        _row_add(ix, ix->next, ix->chars, n, wrapped);
+        if ((ecore_time_get() - t0) >= INDEX_SLICE) break;
+     }
+   termpty_cellcomp_thaw(ty);
+   _budget_enforce();
+   if (ix->next < ty->backsaved) return ECORE_CALLBACK_RENEW;
+   termpty_row_view_free(&(ix->view));
+   ix->idler = NULL;
+   return ECORE_CALLBACK_CANCEL;
+}
+
+void
+termpty_index_set(Termpty *ty, Eina_Bool enabled)
+{
+   Termindex *ix;
+
+   EINA_SAFETY_ON_NULL_RETURN(ty);
+   if (!!ty->index == !!enabled) return;
+   if (!enabled)
+     {
+        ix = ty->index;
+        ty->index = NULL;
+        _indexes = eina_list_remove(_indexes, ix);
+        if (ix->idler) ecore_idler_del(ix->idler);
+        eina_hash_free(ix->grams);
+        _bytes -= ix->bytes;
+        termpty_row_view_free(&(ix->view));
+        free(ix->chars);
+        free(ix);
+        return;
+     }
+   ix = calloc(1, sizeof(Termindex));
+   if (!ix) return;
+   ix->grams = eina_hash_int32_new(_gram_free);
+   if (!ix->grams)
+     {
+        free(ix);
+        return;
+     }
+   ix->ty = ty;
+   ty->index = ix;
+   _indexes = eina_list_append(_indexes, ix);
+   _reset(ix);
+}
+
+Eina_Bool
+termpty_index_get(const Termpty *ty)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, EINA_FALSE);
+   return !!ty->index;
+}
+
+void
+termpty_index_budget_set(uint64_t bytes)
+{
+   if (_budget == bytes) return;
+   _budget = bytes;
+   _budget_enforce();
+}
+
+void
+termpty_index_row_add(Termpty *ty, const Termcell *cells, int w_max)
+{
+   Termindex *ix = ty->index;
+   long long row = ty->backsaved - 1, oldest;
+   int x, w, n = 0;
+
+   if (!ix) return;
+   if ((ix->backgen != ty->backgen) ||
+       ((row - ix->base) >= (long long)0x7fffffff))
+     _reset(ix);
+   // still building, the idler gets to this row later
+   if (ix->idler) return;
+   if (ix->next != row)
+     {
+        ix->idler = ecore_idler_add(_cb_idle, ix);
+        return;
+     }
+   w = termpty_line_length(cells, w_max);
+   if (!_chars_grow(ix, w)) return;
+   for (x = 0; x < w; x++)
+     n = _char_put(ix->chars, n, cells[x].codepoint, &(cells[x].att));
+   _row_add(ix, row, ix->chars, n,
+            (w_max > 0) && (cells[w_max - 1].att.autowrapped));
+   // lines gone from history are dropped in batches
+   oldest = ty->backsaved - ty->backscroll_num;
+   if (oldest > ix->floor + MAX((ix->next - ix->floor) / 8, 1024))
+     _prune(ix, oldest);
+   if ((_budget > 0) && (_bytes > _budget)) _budget_enforce();
+}
+
+static int
+_gram_cmp(const void *a, const void *b)
+{
+   const Termgram *g1 = *(const Termgram **)a, *g2 = *(const Termgram **)b;
+
+   return g1->num - g2->num;
+}
+
+static Eina_Bool
+_gram_has(const Termgram *g, unsigned int r)
+{
+   int lo = 0, hi = g->num;
+
+   while (lo < hi)
+     {
+        int mid = (lo + hi) / 2;
+
+        if (g->rows[mid] < r) lo = mid + 1;
+        else hi = mid;
+     }
+   return (lo < g->num) && (g->rows[lo] == r);
+}
+
+Eina_Bool
+termpty_index_find(Termpty *ty, const char *str,
+                   long long **rows, int *num,
+                   long long *from, long long *to)
+{
+   Termindex *ix;
+   Eina_Unicode *chars;
+   Termgram **grams;
+   unsigned int floor;
+   int i, j, len = 0, ngrams = 0, n = 0;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(str, EINA_FALSE);
+   ix = ty->index;
+   *rows = NULL;
+   *num = 0;
+   if ((!ix) || (ix->backgen != ty->backgen)) return EINA_FALSE;
+   chars = eina_unicode_utf8_to_unicode(str, &len);
+   if ((!chars) || (len < 3))
+     {
+        free(chars);
+        return EINA_FALSE;
+     }
+   grams = alloca((len - 2) * sizeof(Termgram *));
+   for (i = 0; i < len - 2; i++)
+     {
+        unsigned int key;
+
+        if ((chars[i] == ' ') && (chars[i + 1] == ' ') && (chars[i + 2] == ' '))
+          continue;
+        key = _gram_key(chars[i], chars[i + 1], chars[i + 2]);
+        grams[ngrams] = eina_hash_find(ix->grams, &key);
+        // a trigram no line has, nothing can match
+        if (!grams[ngrams])
+          {
+             free(chars);
+             *from = ix->floor;
+             *to = ix->next;
+             return EINA_TRUE;
+          }
+        ngrams++;
+     }
+   free(chars);
+   if (ngrams == 0) return EINA_FALSE;
+   // walk the shortest list, look the others up
+   qsort(grams, ngrams, sizeof(Termgram *), _gram_cmp);
+   *rows = malloc((grams[0]->num + 1) * sizeof(long long));
+   if (!*rows) return EINA_FALSE;
+   floor = ix->floor - ix->base;
+   for (i = 0; i < grams[0]->num; i++)
+     {
+        unsigned int r = grams[0]->rows[i];
+
+        if (r < floor) continue;
+        for (j = 1; j < ngrams; j++)
+          {
+             if (!_gram_has(grams[j], r)) break;
+          }
+        if (j == ngrams) (*rows)[n++] = ix->base + r;
+     }
+   *num = n;
+   *from = ix->floor;
+   *to = ix->next;
+   return EINA_TRUE;
+}
+
+void
+termpty_index_stats_get(const Termpty *ty, Termindex_Stats *st)
+{
+   Termindex *ix;
+
+   EINA_SAFETY_ON_NULL_RETURN(ty);
+   EINA_SAFETY_ON_NULL_RETURN(st);
+   memset(st, 0, sizeof(Termindex_Stats));
+   st->bytes_all = _bytes;
+   st->bytes_budget = _budget;
+   ix = ty->index;
+   if (!ix) return;
+   st->rows = ix->next - ix->floor;
+   st->grams = eina_hash_population(ix->grams);
+   st->postings = ix->postings;
+   st->bytes = ix->bytes;
+   st->building = !!ix->idler;
+}
@@ -0,0 +1,33 @@
+#ifndef _TERMPTY_INDEX_H__
+#define _TERMPTY_INDEX_H__ 1
+
+typedef struct _Termindex_Stats Termindex_Stats;
+
+struct _Termindex_Stats
+{
+   int rows; /* rows of history covered */
+   int grams;
+   uint64_t postings;
+   uint64_t bytes;
+   Eina_Bool building; /* still catching up with history */
+   /* process wide */
+   uint64_t bytes_all;
+   uint64_t bytes_budget;
+};
+
+/* keep a trigram index of the history of ty, built from what is there */
+void termpty_index_set(Termpty *ty, Eina_Bool enabled);
+Eina_Bool termpty_index_get(const Termpty *ty);
+/* process-wide limit in bytes on all indexes, 0 = unlimited */
+void termpty_index_budget_set(uint64_t bytes);
+/* a row just went into history, see termpty_text_save_top() */
+void termpty_index_row_add(Termpty *ty, const Termcell *cells, int w_max);
+/* rows from and up to (not including) to are covered, of those only the
+ * lines starting at the returned rows can hold str. false if the index
+ * cannot tell, rows is to be freed */
+Eina_Bool termpty_index_find(Termpty *ty, const char *str,
+                             long long **rows, int *num,
+                             long long *from, long long *to);
+void termpty_index_stats_get(const Termpty *ty, Termindex_Stats *st);
+
+#endif
@@ -0,0 +1,282 @@
+#include "private.h"
+
+#include <Elementary.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "termpty.h"
+#include "termptylog.h"
+#include "lz4/lz4.h"
+
+/* bytes of output held for the writer, more than that gets dropped */
+#define LOG_RING (1024 * 1024)
+/* most bytes written at once, the block size of the lz4 frame */
+#define LOG_BLOCK (64 * 1024)
+/* seconds the writer waits for a full block before writing less */
+#define LOG_DELAY 0.25
+
+/* the read path copies what it read into a ring and never waits on the
+ * writer, which takes it out of the ring and writes it down in a thread
+ * of its own.
+ *
+ * lz4 logs are lz4 frames as the lz4 tool reads them: independent blocks
+ * of up to 64KiB, no checksums, ended by a zero length block */
+
+static const unsigned char _lz4_header[7] =
+{
+   0x04, 0x22, 0x4d, 0x18, // magic
+   0x60, // version 1, independent blocks
+   0x40, // blocks of up to 64KiB
+   0x82 // second byte of the xxhash32 of the two above
+};
+
+struct _Termlog
+{
+   Termpty *ty; /* NULL once ty has let go of the log */
+   const char *path;
+   int fd;
+   Eina_Bool lz4;
+   Ecore_Thread *thread;
+   /* all below are shared with the writer */
+   Eina_Lock lock;
+   Eina_Condition cond;
+   char *ring;
+   size_t head, tail; /* bytes ever put in and taken out */
+   unsigned long long dropped;
+   Eina_Bool dropping;
+   Eina_Bool quit;
+   int err;
+};
+
+static Eina_Bool
+_write_all(Termlog *log, const void *data, size_t len)
+{
+   const char *p = data;
+
+   while (len > 0)
+     {
+        ssize_t n = write(log->fd, p, len);
+
+        if (n < 0)
+          {
+             if (errno == EINTR) continue;
+             log->err = errno;
+             return EINA_FALSE;
+          }
+        p += n;
+        len -= n;
+     }
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_write_block(Termlog *log, const char *data, int len, char *zbuf)
+{
+   unsigned char hdr[4];
+   unsigned int size;
+   int bytes;
+
+   if (!log->lz4) return _write_all(log, data, len);
+   bytes = LZ4_compress(data, zbuf, len);
+   // the high bit marks blocks stored as they are
+   if ((bytes <= 0) || (bytes >= len))
+     {
+        size = len | 0x80000000;
+        zbuf = (char *)data;
+        bytes = len;
+     }
+   else size = bytes;
+   hdr[0] = size & 0xff;
+   hdr[1] = (size >> 8) & 0xff;
+   hdr[2] = (size >> 16) & 0xff;
+   hdr[3] = (size >> 24) & 0xff;
+   return (_write_all(log, hdr, sizeof(hdr))) &&
+     (_write_all(log, zbuf, bytes));
+}
+
+static void
+_log_run(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Termlog *log = data;
+   char *zbuf = NULL;
+
+   if (log->lz4)
+     {
+        zbuf = malloc(LZ4_compressBound(LOG_BLOCK));
+        if ((!zbuf) || (!_write_all(log, _lz4_header, sizeof(_lz4_header))))
+          {
+             if (!zbuf) log->err = ENOMEM;
+             free(zbuf);
+             return;
+          }
+     }
+   for (;;)
+     {
+        size_t off, n;
+        Eina_Bool ok;
+
+        eina_lock_take(&(log->lock));
+        while ((log->head == log->tail) && (!log->quit))
+          eina_condition_wait(&(log->cond));
+        // gather a block unless output has stopped for a while
+        if (!log->quit)
+          {
+             double t0 = ecore_time_get(), t;
+
+             while (((log->head - log->tail) < LOG_BLOCK) && (!log->quit) &&
+                    ((t = LOG_DELAY - (ecore_time_get() - t0)) > 0.0))
+               eina_condition_timedwait(&(log->cond), t);
+          }
+        if (log->head == log->tail)
+          {
+             eina_lock_release(&(log->lock));
+             break;
+          }
+        off = log->tail % LOG_RING;
+        n = MIN(log->head - log->tail, LOG_RING - off);
+        if (n > LOG_BLOCK) n = LOG_BLOCK;
+        eina_lock_release(&(log->lock));
+
+        // the reader leaves what is between tail and head alone
+        ok = _write_block(log, log->ring + off, n, zbuf);
+
+        eina_lock_take(&(log->lock));
+        log->tail += n;
+        eina_lock_release(&(log->lock));
+        if (!ok) break;
+     }
+   if ((log->lz4) && (!log->err))
+     {
+        static const unsigned char end[4] = { 0, 0, 0, 0 };
+
+        _write_all(log, end, sizeof(end));
+     }
+   free(zbuf);
+}
+
+/* called for a finished writer as well as one that never ran */
+static void
+_log_end(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Termlog *log = data;
+
+   if (log->ty) log->ty->log = NULL;
+   if (log->err)
+     ERR(_("Could not write log %s: %s"), log->path, strerror(log->err));
+   if (log->dropped > 0)
+     WRN("Log %s misses %llu bytes of output", log->path, log->dropped);
+   if ((close(log->fd) < 0) && (!log->err))
+     ERR(_("Could not write log %s: %s"), log->path, strerror(errno));
+   eina_condition_free(&(log->cond));
+   eina_lock_free(&(log->lock));
+   eina_stringshare_del(log->path);
+   free(log->ring);
+   free(log);
+}
+
+static void
+_log_stop(Termpty *ty)
+{
+   Termlog *log = ty->log;
+
+   if (!log) return;
+   ty->log = NULL;
+   log->ty = NULL;
+   // the writer drains the ring before it ends
+   eina_lock_take(&(log->lock));
+   log->quit = EINA_TRUE;
+   eina_condition_signal(&(log->cond));
+   eina_lock_release(&(log->lock));
+}
+
+Eina_Bool
+termpty_log_set(Termpty *ty, const char *path, Eina_Bool lz4)
+{
+   Termlog *log;
+   Ecore_Thread *thread;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, EINA_FALSE);
+   _log_stop(ty);
+   if (!path) return EINA_TRUE;
+
+   log = calloc(1, sizeof(Termlog));
+   if (!log) return EINA_FALSE;
+   log->ring = malloc(LOG_RING);
+   if (!log->ring)
+     {
+        free(log);
+        return EINA_FALSE;
+     }
+   log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+   if (log->fd < 0)
+     {
+        ERR(_("Could not open log %s: %s"), path, strerror(errno));
+        free(log->ring);
+        free(log);
+        return EINA_FALSE;
+     }
+   if (!eina_lock_new(&(log->lock)))
+     {
+        close(log->fd);
+        free(log->ring);
+        free(log);
+        return EINA_FALSE;
+     }
+   if (!eina_condition_new(&(log->cond), &(log->lock)))
+     {
+        eina_lock_free(&(log->lock));
+        close(log->fd);
+        free(log->ring);
+        free(log);
+        return EINA_FALSE;
+     }
+   log->path = eina_stringshare_add(path);
+   log->lz4 = !!lz4;
+   log->ty = ty;
+   ty->log = log;
+   // a thread of its own, it is there for as long as the log
+   thread = ecore_thread_feedback_run(_log_run, NULL, _log_end, _log_end,
+                                      log, EINA_TRUE);
+   // on failure the log has been ended already
+   if (!thread) return EINA_FALSE;
+   log->thread = thread;
+   return EINA_TRUE;
+}
+
+const char *
+termpty_log_path_get(const Termpty *ty)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, NULL);
+   if (!ty->log) return NULL;
+   return ty->log->path;
+}
+
+void
+termpty_log_add(Termpty *ty, const char *buf, int len)
+{
+   Termlog *log = ty->log;
+   size_t off, n;
+   Eina_Bool warn = EINA_FALSE;
+
+   if ((!log) || (len <= 0)) return;
+   eina_lock_take(&(log->lock));
+   if (log->err) goto done;
+   // a read goes in whole or not at all, so escapes are not torn
+   if ((size_t)len > (LOG_RING - (log->head - log->tail)))
+     {
+        warn = !log->dropping;
+        log->dropping = EINA_TRUE;
+        log->dropped += len;
+        goto done;
+     }
+   log->dropping = EINA_FALSE;
+   off = log->head % LOG_RING;
+   n = MIN((size_t)len, LOG_RING - off);
+   memcpy(log->ring + off, buf, n);
+   memcpy(log->ring, buf + n, len - n);
+   log->head += len;
+   eina_condition_signal(&(log->cond));
+done:
+   eina_lock_release(&(log->lock));
+   if (warn) DBG("log %s falls behind, dropping output", log->path);
+}
@@ -0,0 +1,12 @@
+#ifndef _TERMPTY_LOG_H__
+#define _TERMPTY_LOG_H__ 1
+
+/* log all output of ty as read from the pty to path, as an lz4 frame if
+ * lz4 is set. NULL path stops logging. the file is written by a thread,
+ * output coming faster than it can write is left out of the log */
+Eina_Bool termpty_log_set(Termpty *ty, const char *path, Eina_Bool lz4);
+const char *termpty_log_path_get(const Termpty *ty);
+/* bytes just read from the pty, see _cb_fd_read() */
+void termpty_log_add(Termpty *ty, const char *buf, int len);
+
+#endif
@@ -6,6 +6,7 @@
 #include "termptyops.h"
 #include "termptygfx.h"
 #include "termptysave.h"
+#include "termptyindex.h"
 #include "miniview.h"
 
 static void
@@ -25,25 +26,33 @@ termpty_text_save_top(Termpty *ty, Termcell *cells, ssize_t w_max)
    Termsave *ts;
    ssize_t w;
 
+   // counted even when dropped, the rows below still move up
+   ty->backsaved++;
    if (ty->backmax <= 0) return;
 
    termpty_save_freeze();
    w = termpty_line_length(cells, w_max);
-   ts = termpty_save_new(w);
+   ts = termpty_save_intern(cells, w);
    if (!ts)
-     return;
-   termpty_cell_copy(ty, cells, ts->cell, w);
-   if (!ty->back) ty->back = calloc(1, sizeof(Termsave *) * ty->backmax);
-   if (ty->back[ty->backpos])
      {
-        termpty_save_free(ty->back[ty->backpos]);
-        ty->back[ty->backpos] = NULL;
+        termpty_save_thaw();
+        return;
+     }
+   termpty_cell_ref(ty, cells, w);
+   termpty_save_free(termpty_back_get(&ty->back, ty->backpos));
+   if (!termpty_back_set(&ty->back, ty->backmax, ty->backpos, ts))
+     {
+        termpty_save_free(ts);
+        termpty_save_thaw();
+        return;
      }
-   ty->back[ty->backpos] = ts;
+   // a full history just lost its oldest row
+   if (ty->backscroll_num >= ty->backmax) termpty_rewrap_drop(ty, 1);
    ty->backpos++;
    if (ty->backpos >= ty->backmax) ty->backpos = 0;
    ty->backscroll_num++;
    if (ty->backscroll_num >= ty->backmax) ty->backscroll_num = ty->backmax;
+   termpty_index_row_add(ty, cells, w_max);
    termpty_save_thaw();
 }
 
@@ -187,6 +196,7 @@ _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
 
         termpty_cell_codepoint_att_fill(ty, g, ty->state.att,
                                         &(cells[ty->state.cx]), 1);
+        cells[ty->state.cx].link = ty->state.link;
 #if defined(SUPPORT_DBLWIDTH)
         cells[ty->state.cx].att.dblwidth = _termpty_is_dblwidth_get(ty, g);
         if (EINA_UNLIKELY((cells[ty->state.cx].att.dblwidth) && (ty->state.cx < (ty->w - 1))))
@@ -194,6 +204,7 @@ _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
              TERMPTY_FMTCLR(cells[ty->state.cx].att);
              termpty_cell_codepoint_att_fill(ty, 0, cells[ty->state.cx].att,
                                              &(cells[ty->state.cx + 1]), 1);
+             cells[ty->state.cx + 1].link = ty->state.link;
           }
 #endif        
         if (ty->state.wrap)
@@ -342,6 +353,8 @@ _termpty_reset_att(Termatt *att)
    att->strike = 0;
    att->fg256 = 0;
    att->bg256 = 0;
+   att->fgrgb = 0;
+   att->bgrgb = 0;
    att->fgintense = 0;
    att->bgintense = 0;
    att->autowrapped = 0;
@@ -360,6 +373,7 @@ _termpty_reset_state(Termpty *ty)
    ty->state.had_cr_x = 0;
    ty->state.had_cr_y = 0;
    _termpty_reset_att(&(ty->state.att));
+   ty->state.link = 0;
    ty->state.charset = 0;
    ty->state.charsetch = 'B';
    ty->state.chset[0] = 'B';
@@ -380,21 +394,13 @@ _termpty_reset_state(Termpty *ty)
    ty->bracketed_paste = 0;
 
    termpty_save_freeze();
-   if (ty->back)
-     {
-        int i;
-        for (i = 0; i < ty->backmax; i++)
-          {
-             if (ty->back[i]) termpty_save_free(ty->back[i]);
-          }
-        free(ty->back);
-        ty->back = NULL;
-     }
+   termpty_rewrap_cancel(ty);
+   termpty_back_free(&ty->back);
    ty->backscroll_num = 0;
    ty->backpos = 0;
-   if (ty->backmax)
-     ty->back = calloc(1, sizeof(Termsave *) * ty->backmax);
+   ty->backgen++;
    termpty_save_thaw();
+   termpty_rgb_reset(ty);
 }
 
 void
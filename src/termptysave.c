@@ -1,9 +1,16 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE 1
+#endif
 #include "private.h"
 #include <Elementary.h>
 #include "termpty.h"
 #include "termptysave.h"
 #include "lz4/lz4.h"
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <unistd.h>
 
 #if defined (__MacOSX__) || (defined (__MACH__) && defined (__APPLE__))
 # ifndef MAP_ANONYMOUS
@@ -17,6 +24,23 @@
 #define TS_MMAP_SIZE 131072
 #define TS_ALLOC_MASK (TS_MMAP_SIZE - 1)
 
+#define SPILL_MAX        1024
+#define SPILL_KEEP_ROWS  4096
+#define SPILL_BATCH      65536
+#define SPILL_BATCH_ROWS 1024
+
+#define DEDUP_SLOTS      4096
+#define DEDUP_MASK       (DEDUP_SLOTS - 1)
+
+#define COMPACT_BLOCKS   8
+
+// palette rows - an entry is the 8 bytes of a Termcell after its codepoint
+#define PAL_MAX          256
+#define PAL_ATT_OFF      offsetof(Termcell, att)
+#define PAL_ATT_SIZE     sizeof(uint64_t)
+
+#define SCREEN_PACK_IDLE 120.0
+
 typedef struct _Alloc Alloc;
 
 struct _Alloc
@@ -24,12 +48,34 @@ struct _Alloc
    unsigned int size, last, count, allocated;
    short slot;
    unsigned char gen;
-   unsigned char __pad;
+   unsigned char evac; // being emptied by compaction, no new rows here
+};
+
+struct _Termspill
+{
+   int fd;
+   unsigned int slot;
+   unsigned int rows;
+   uint64_t size;
 };
 
 static uint64_t _allocated = 0;
+static uint64_t _budget = 0;
+static uint64_t _unmapped = 0;
+static uint64_t _reclaimed = 0;
+// rows rewrapped in idle time and not swapped into history yet, as of
+// the last compressor run - eviction cannot take those
+static uint64_t _pending = 0;
 static unsigned char cur_gen = 0;
 static Alloc *alloc[MEM_BLOCKS] =  { 0 };
+static Termspill *spills[SPILL_MAX] = { 0 };
+static Termsave_Policy policy = { 256, 4096, 256 };
+// recently stored compressed rows by content hash, to share repeats
+static Termsavecomp *dedup[DEDUP_SLOTS] = { 0 };
+// refcounts of rows with the shared bit set
+static Eina_Hash *dedup_refs = NULL;
+// all blank rows point here - they cost nothing but the pointer
+static Termsave _blank_row;
 
 static int
 roundup_block_size(int sz)
@@ -74,7 +120,7 @@ _alloc_new(int size, unsigned char gen)
              continue;
           }
         // if generation count matches
-        if (alloc[i]->gen == gen)
+        if ((alloc[i]->gen == gen) && (!alloc[i]->evac))
           {
              // if there is space in the block
              if ((alloc[i]->size - alloc[i]->last) >= newsize)
@@ -115,6 +161,7 @@ _alloc_new(int size, unsigned char gen)
    al->allocated = newsize;
    al->slot = firstnull;
    al->gen = gen;
+   al->evac = 0;
    _allocated += newsize;
    alloc[al->slot] = al;
    ptr = (unsigned char *)al;
@@ -133,20 +180,182 @@ _ts_new(int size)
    return ptr;
 }
 
+static unsigned int
+_dedup_hash(const char *buf, int bytes, int wout, Eina_Bool cold)
+{
+   unsigned int h = 2166136261U;
+   int i;
+
+   for (i = 0; i < bytes; i++)
+     h = (h ^ (unsigned char)buf[i]) * 16777619U;
+   h ^= (wout << 1) | cold;
+   return h;
+}
+
+static unsigned int
+_dedup_slot(const Termsavecomp *tsc)
+{
+   return _dedup_hash(((const char *)tsc) + sizeof(Termsavecomp), tsc->w,
+                      tsc->wout, tsc->cold) & DEDUP_MASK;
+}
+
+static Termsavecomp *
+_dedup_ref(const char *buf, int bytes, int wout, Eina_Bool cold,
+           unsigned int slot)
+{
+   Termsavecomp *tsc = dedup[slot];
+   intptr_t refs;
+
+   if (!tsc) return NULL;
+   if (((int)tsc->w != bytes) || ((int)tsc->wout != wout) ||
+       (tsc->cold != cold) || (tsc->spill))
+     return NULL;
+   if (memcmp(((char *)tsc) + sizeof(Termsavecomp), buf, bytes)) return NULL;
+   if (!dedup_refs) dedup_refs = eina_hash_pointer_new(NULL);
+   if (!dedup_refs) return NULL;
+   if (tsc->shared)
+     {
+        refs = (intptr_t)eina_hash_find(dedup_refs, &tsc);
+        eina_hash_modify(dedup_refs, &tsc, (void *)(refs + 1));
+     }
+   else
+     {
+        if (!eina_hash_add(dedup_refs, &tsc, (void *)(intptr_t)2))
+          return NULL;
+        tsc->shared = 1;
+     }
+   return tsc;
+}
+
+// drops one reference to a shared row, returns EINA_TRUE if others remain
+static Eina_Bool
+_dedup_unref(Termsavecomp *tsc)
+{
+   intptr_t refs;
+
+   if (!tsc->shared) return EINA_FALSE;
+   refs = (intptr_t)eina_hash_find(dedup_refs, &tsc);
+   if (refs > 2)
+     eina_hash_modify(dedup_refs, &tsc, (void *)(refs - 1));
+   else
+     {
+        // back to a single owner
+        eina_hash_del_by_key(dedup_refs, &tsc);
+        tsc->shared = 0;
+     }
+   return EINA_TRUE;
+}
+
 static void
-_ts_free(void *ptr)
+_spill_release(Termsavespill *tss)
 {
-   Alloc *al;
-   unsigned int sz;
-   Termsavecomp *ts = ptr;
+   Termspill *sp = spills[tss->file];
 
-   if (!ptr) return;
+   if (!sp) return;
+   sp->rows--;
+   if (sp->rows == 0)
+     {
+        // nothing left in the file, so start it over from scratch
+        if (ftruncate(sp->fd, 0) < 0)
+          ERR("Cannot truncate spill file: %s", strerror(errno));
+        sp->size = 0;
+        return;
+     }
+#ifdef FALLOC_FL_PUNCH_HOLE
+   // give the disk space back - filesystems without hole support just
+   // keep it until the file is truncated or closed
+   fallocate(sp->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+             (off_t)tss->off * MEM_ALLOC_ALIGN, roundup_block_size(tss->w));
+#endif
+}
 
-   if (ts->comp)
+static int
+_spill_load(Termsavespill *tss, char *dst, int size)
+{
+   Termspill *sp = spills[tss->file];
+   char local[4096], *buf = local;
+   off_t off;
+   size_t got = 0;
+   int bytes = -1;
+
+   if (!sp) return -1;
+   // a row is a few KB at most, reading it is cheaper than mapping it
+   if (tss->w > sizeof(local))
+     {
+        buf = malloc(tss->w);
+        if (!buf) return -1;
+     }
+   off = (off_t)tss->off * MEM_ALLOC_ALIGN;
+   while (got < tss->w)
+     {
+        ssize_t rd = pread(sp->fd, buf + got, tss->w - got, off + got);
+
+        if ((rd < 0) && (errno == EINTR)) continue;
+        if (rd <= 0)
+          {
+             ERR("Cannot read spilled row back in: %s",
+                 (rd < 0) ? strerror(errno) : "short read");
+             goto done;
+          }
+        got += rd;
+     }
+   bytes = LZ4_uncompress(buf, dst, size);
+done:
+   if (buf != local) free(buf);
+   return bytes;
+}
+
+static unsigned int
+_pal_size(int npal, int w)
+{
+   return sizeof(Termsavepal) + (npal * PAL_ATT_SIZE) +
+     (w * sizeof(Eina_Unicode)) + w;
+}
+
+static void
+_pal_unpack(const Termsavepal *tsp, Termcell *cells)
+{
+   const unsigned char *pal = (const unsigned char *)(tsp + 1);
+   const Eina_Unicode *cp;
+   const unsigned char *idx;
+   int i;
+
+   cp = (const Eina_Unicode *)(pal + (tsp->npal * PAL_ATT_SIZE));
+   idx = (const unsigned char *)(cp + tsp->w);
+   for (i = 0; i < (int)tsp->w; i++)
+     {
+        cells[i].codepoint = cp[i];
+        memcpy(((unsigned char *)&(cells[i])) + PAL_ATT_OFF,
+               pal + (idx[i] * PAL_ATT_SIZE), PAL_ATT_SIZE);
+     }
+}
+
+static unsigned int
+_ts_size(const void *ptr)
+{
+   const Termsavecomp *ts = ptr;
+   unsigned int sz;
+
+   if (ts->spill)
+     sz = sizeof(Termsavespill);
+   else if (ts->comp)
      sz = sizeof(Termsavecomp) + ts->w;
+   else if (ts->pal)
+     sz = _pal_size(((const Termsavepal *)ts)->npal, ts->w);
    else
      sz = sizeof(Termsave) + ((ts->w - 1) * sizeof(Termcell));
-   sz = roundup_block_size(sz);
+   return roundup_block_size(sz);
+}
+
+/* gives the space of ptr back to its block and nothing else, for rows
+ * whose spill file space and dedup slot have been handed on */
+static void
+_ts_block_free(void *ptr)
+{
+   Alloc *al;
+   unsigned int sz;
+
+   sz = _ts_size(ptr);
    _allocated -= sz;
 
    al = _alloc_find(ptr);
@@ -159,9 +368,30 @@ _ts_free(void *ptr)
    al->allocated -= sz;
    if (al->count > 0) return;
    alloc[al->slot] = NULL;
+   _unmapped += al->size;
    munmap(al, al->size);
 }
 
+static void
+_ts_free(void *ptr)
+{
+   Termsavecomp *ts = ptr;
+
+   if (!ptr) return;
+   if (ptr == &_blank_row) return;
+   if ((ts->shared) && (_dedup_unref(ptr))) return;
+
+   if (ts->spill)
+     _spill_release(ptr);
+   else if (ts->comp)
+     {
+        unsigned int slot = _dedup_slot(ts);
+
+        if (dedup[slot] == ts) dedup[slot] = NULL;
+     }
+   _ts_block_free(ptr);
+}
+
 static void
 _mem_defrag(void)
 {
@@ -196,8 +426,14 @@ _mem_gen_get(void)
    return cur_gen;
 }
 
+static Ecore_Idler *compact_idler = NULL;
+
+static double ts_comptime = 0.0;
+static int ts_compruns = 0;
+static Ecore_Timer *screen_timer = NULL;
 static int ts_comp = 0;
 static int ts_uncomp = 0;
+static int ts_uncomp_hot = 0;
 static int ts_freeops = 0;
 static int ts_compfreeze = 0;
 static int freeze = 0;
@@ -205,6 +441,79 @@ static Eina_List *ptys = NULL;
 static Ecore_Idler *idler = NULL;
 static Ecore_Timer *timer = NULL;
 
+static Eina_Bool
+_over_budget(void)
+{
+   return (_budget > 0) && (_allocated > (_budget + _pending));
+}
+
+static void
+_policy_current(Termsave_Policy *p)
+{
+   int shift = 0;
+
+   *p = policy;
+   if (_budget <= 0) return;
+   // the closer we get to the budget the less we keep raw or fast to
+   // decompress, and the sooner the compressor gets going
+   if (_allocated >= ((_budget / 4) * 3)) shift = 2;
+   else if (_allocated >= (_budget / 2)) shift = 1;
+   p->hot_rows >>= shift;
+   p->warm_rows >>= shift;
+   p->trigger >>= shift;
+   if (p->trigger < 16) p->trigger = 16;
+}
+
+static void
+_cells_planes_split(const unsigned char *src, unsigned char *dst, int num)
+{
+   int i, b;
+
+   // byte n of every cell together - codepoints and attributes hardly
+   // change along a row, so this gives lz4 long runs to work with
+   for (b = 0; b < (int)sizeof(Termcell); b++)
+     {
+        for (i = 0; i < num; i++)
+          *(dst++) = src[(i * sizeof(Termcell)) + b];
+     }
+}
+
+static void
+_cells_planes_join(const unsigned char *src, unsigned char *dst, int num)
+{
+   int i, b;
+
+   for (b = 0; b < (int)sizeof(Termcell); b++)
+     {
+        for (i = 0; i < num; i++)
+          dst[(i * sizeof(Termcell)) + b] = *(src++);
+     }
+}
+
+static Termsavecomp *
+_comp_store(const char *buf, int bytes, int wout, Eina_Bool cold)
+{
+   Termsavecomp *tsc;
+   unsigned int slot;
+
+   slot = _dedup_hash(buf, bytes, wout, cold) & DEDUP_MASK;
+   tsc = _dedup_ref(buf, bytes, wout, cold, slot);
+   if (tsc) return tsc;
+   tsc = _ts_new(sizeof(Termsavecomp) + bytes);
+   if (!tsc) return NULL;
+   tsc->gen = _mem_gen_get();
+   tsc->shared = 0;
+   tsc->comp = 1;
+   tsc->z = 1;
+   tsc->spill = 0;
+   tsc->cold = cold;
+   tsc->w = bytes;
+   tsc->wout = wout;
+   memcpy(((char *)tsc) + sizeof(Termsavecomp), buf, bytes);
+   dedup[slot] = tsc;
+   return tsc;
+}
+
 static Termsave *
 _save_comp(Termsave *ts)
 {
@@ -212,30 +521,29 @@ _save_comp(Termsave *ts)
    Termsavecomp *tsc;
 
    // already compacted
-   if (ts->comp) return ts;
+   if ((ts->comp) || (ts == &_blank_row)) return ts;
    // make new allocation for new generation
    ts_compfreeze++;
    if (!ts->z)
      {
         int bytes;
         char *buf;
+        Termcell *cells = &(ts->cell[0]);
 
+        if (ts->pal)
+          {
+             cells = alloca(ts->w * sizeof(Termcell));
+             _pal_unpack((Termsavepal *)ts, cells);
+          }
         buf = alloca(LZ4_compressBound(ts->w * sizeof(Termcell)));
-        bytes = LZ4_compress((char *)(&(ts->cell[0])), buf,
-                             ts->w * sizeof(Termcell));
-        tsc = _ts_new(sizeof(Termsavecomp) + bytes);
+        bytes = LZ4_compress((char *)cells, buf, ts->w * sizeof(Termcell));
+        tsc = _comp_store(buf, bytes, ts->w, EINA_FALSE);
         if (!tsc)
           {
              ERR("Big problem. Can't allocate backscroll compress buffer");
              ts2 = ts;
              goto done;
           }
-        tsc->comp = 1;
-        tsc->z = 1;
-        tsc->gen = _mem_gen_get();
-        tsc->w = bytes;
-        tsc->wout = ts->w;
-        memcpy(((char *)tsc) + sizeof(Termsavecomp), buf, bytes);
         ts2 = (Termsave *)tsc;
      }
    else
@@ -258,28 +566,502 @@ done:
    return ts2;
 }
 
+static Termsave *
+_save_cold(Termsave *ts)
+{
+   Termsavecomp *tsc = (Termsavecomp *)ts, *tsc2;
+   unsigned char *cells, *planes;
+   char *buf;
+   int size, wout, bytes;
+
+   if ((ts->spill) || (ts->cold) || (ts == &_blank_row)) return ts;
+   if (ts->comp)
+     {
+        wout = tsc->wout;
+        size = wout * sizeof(Termcell);
+        cells = alloca(size);
+        if (LZ4_uncompress(((char *)tsc) + sizeof(Termsavecomp),
+                           (char *)cells, size) < 0)
+          return ts;
+     }
+   else if (ts->pal)
+     {
+        wout = ts->w;
+        size = wout * sizeof(Termcell);
+        cells = alloca(size);
+        _pal_unpack((Termsavepal *)ts, (Termcell *)cells);
+     }
+   else
+     {
+        wout = ts->w;
+        size = wout * sizeof(Termcell);
+        cells = (unsigned char *)(&(ts->cell[0]));
+     }
+   planes = alloca(size);
+   _cells_planes_split(cells, planes, wout);
+   buf = alloca(LZ4_compressBound(size));
+   bytes = LZ4_compress((char *)planes, buf, size);
+   tsc2 = _comp_store(buf, bytes, wout, EINA_TRUE);
+   if (!tsc2)
+     {
+        ERR("Big problem. Can't allocate backscroll cold buffer");
+        return ts;
+     }
+   ts_compfreeze++;
+   termpty_save_free(ts);
+   ts_compfreeze--;
+   return (Termsave *)tsc2;
+}
+
+/* the marks of rows already done are dropped once history got rewritten */
+static void
+_marks_check(Termpty *ty)
+{
+   if (ty->backmark_gen == ty->backgen) return;
+   ty->backcold = ty->backspilled = 0;
+   ty->backmark_gen = ty->backgen;
+}
+
+static void
+_walk_pty(Termpty *ty, const Termsave_Policy *p)
+{
+   long long low = ty->backsaved;
+   int n, num;
+
+   if (!ty->back.chunks) return;
+   _marks_check(ty);
+   // rows older than backcold are cold already and stay so
+   num = MIN(ty->backscroll_num, ty->backsaved - ty->backcold);
+   // walk from newest to oldest - n is how many rows back a row is
+   for (n = 1; n <= num; n++)
+     {
+        int i = (ty->backpos - n + ty->backmax) % ty->backmax;
+        Termsave *ts = termpty_back_get(&ty->back, i);
+        Termsavecomp *tsc;
+
+        if (!ts) continue;
+        if (n > (p->hot_rows + p->warm_rows))
+          ts = _save_cold(ts);
+        else if (n > p->hot_rows)
+          ts = _save_comp(ts);
+        termpty_back_set(&ty->back, ty->backmax, i, ts);
+        tsc = (Termsavecomp *)ts;
+        if (tsc->comp) ts_comp++;
+        else ts_uncomp++;
+        if ((ts != &_blank_row) && (!ts->cold) && (!ts->spill))
+          low = ty->backsaved - n;
+     }
+   ty->backcold = low;
+}
+
+static Eina_Bool
+_spill_flush(Termpty *ty, const char *buf, int len, const int *pos, int num)
+{
+   Termspill *sp = ty->spill;
+   uint64_t base = sp->size;
+   ssize_t wr;
+   int i, off = 0;
+
+   if (num <= 0) return EINA_TRUE;
+   wr = pwrite(sp->fd, buf, len, base);
+   if (wr != len)
+     {
+        ERR("Cannot write to spill file: %s",
+            (wr < 0) ? strerror(errno) : "short write");
+        return EINA_FALSE;
+     }
+   sp->size += len;
+   ts_compfreeze++;
+   for (i = 0; i < num; i++)
+     {
+        Termsavecomp *tsc;
+        Termsavespill *tss;
+
+        tsc = (Termsavecomp *)termpty_back_get(&ty->back, pos[i]);
+        tss = _ts_new(sizeof(Termsavespill));
+        if (!tss)
+          {
+             ts_compfreeze--;
+             return EINA_FALSE;
+          }
+        tss->gen = _mem_gen_get();
+        tss->shared = 0;
+        tss->comp = 1;
+        tss->z = 1;
+        tss->spill = 1;
+        tss->cold = tsc->cold;
+        tss->w = tsc->w;
+        tss->wout = tsc->wout;
+        tss->file = sp->slot;
+        tss->off = (base + off) / MEM_ALLOC_ALIGN;
+        off += roundup_block_size(tsc->w);
+        sp->rows++;
+        termpty_save_free((Termsave *)tsc);
+        termpty_back_set(&ty->back, ty->backmax, pos[i], (Termsave *)tss);
+     }
+   ts_compfreeze--;
+   return EINA_TRUE;
+}
+
 static void
-_walk_pty(Termpty *ty)
+_spill_pty(Termpty *ty)
+{
+   char *buf;
+   int pos[SPILL_BATCH_ROWS];
+   long long first = 0, left = -1;
+   int n, num = 0, len = 0;
+
+   if ((!ty->spill) || (!ty->back.chunks)) return;
+   _marks_check(ty);
+   // rows older than backspilled went out on an earlier run
+   n = MIN(ty->backscroll_num, ty->backsaved - ty->backspilled);
+   if (n <= SPILL_KEEP_ROWS) return;
+   buf = malloc(SPILL_BATCH);
+   if (!buf) return;
+   // the newest rows stay in memory, everything older than them goes
+   // out to the file oldest first
+   for (; n > SPILL_KEEP_ROWS; n--)
+     {
+        int i = (ty->backpos - n + ty->backmax) % ty->backmax;
+        Termsavecomp *tsc;
+        int sz;
+
+        tsc = (Termsavecomp *)termpty_back_get(&ty->back, i);
+        // shared rows are already stored once for all their users
+        if ((!tsc) || ((Termsave *)tsc == &_blank_row) || (tsc->spill) ||
+            (tsc->shared))
+          continue;
+        // not compressed yet - the next run has to look at it again
+        if (!tsc->comp)
+          {
+             if (left < 0) left = ty->backsaved - n;
+             continue;
+          }
+        sz = roundup_block_size(tsc->w);
+        if (sz > SPILL_BATCH) continue;
+        if ((len + sz > SPILL_BATCH) || (num >= SPILL_BATCH_ROWS))
+          {
+             if (!_spill_flush(ty, buf, len, pos, num))
+               {
+                  if (left < 0) left = first;
+                  goto done;
+               }
+             num = 0;
+             len = 0;
+          }
+        // offsets are stored in alignment units in an unsigned int
+        if (((ty->spill->size + len + sz) / MEM_ALLOC_ALIGN) >= UINT_MAX)
+          {
+             if (left < 0) left = ty->backsaved - n;
+             break;
+          }
+        memcpy(buf + len, ((char *)tsc) + sizeof(Termsavecomp), tsc->w);
+        if (sz > (int)tsc->w) memset(buf + len + tsc->w, 0, sz - tsc->w);
+        if (num == 0) first = ty->backsaved - n;
+        pos[num++] = i;
+        len += sz;
+     }
+   if ((!_spill_flush(ty, buf, len, pos, num)) &&
+       ((left < 0) || (first < left)))
+     left = first;
+done:
+   ty->backspilled = (left >= 0) ? left : (ty->backsaved - n);
+   free(buf);
+}
+
+/* drops the oldest history of ty until num rows that gave memory back
+ * are gone, blank and shared rows go along without counting. returns
+ * the bytes given back */
+static uint64_t
+_evict_pty(Termpty *ty, int num)
+{
+   uint64_t start = _allocated;
+   int i = 0, n = 0;
+
+   if ((!ty->back.chunks) || (ty->backmax <= 0)) return 0;
+   while ((n < num) && (ty->backscroll_num > 0))
+     {
+        uint64_t before = _allocated;
+        int pos;
+
+        // oldest row is the one furthest behind the write position
+        pos = (ty->backpos - ty->backscroll_num + ty->backmax) % ty->backmax;
+        termpty_save_free(termpty_back_get(&ty->back, pos));
+        termpty_back_set(&ty->back, ty->backmax, pos, NULL);
+        // a chunk is done once its last slot goes
+        if ((pos % TERMPTY_BACK_CHUNK) == (TERMPTY_BACK_CHUNK - 1))
+          termpty_back_trim(&ty->back, pos);
+        ty->backscroll_num--;
+        i++;
+        if (_allocated < before) n++;
+     }
+   termpty_rewrap_drop(ty, i);
+   return start - _allocated;
+}
+
+/* arena bytes freeing the history of ty would give back */
+static uint64_t
+_held_bytes(const Termpty *ty)
 {
+   uint64_t bytes = 0;
+   int c, j;
+
+   if (!ty->back.chunks) return 0;
+   for (c = 0; c < ty->back.num; c++)
+     {
+        Termsave **chunk = ty->back.chunks[c];
+
+        if (!chunk) continue;
+        for (j = 0; j < TERMPTY_BACK_CHUNK; j++)
+          {
+             Termsave *ts = chunk[j];
+
+             if ((!ts) || (ts == &_blank_row) || (ts->shared)) continue;
+             bytes += _ts_size(ts);
+          }
+     }
+   return bytes;
+}
+
+static uint64_t
+_pending_bytes(void)
+{
+   Eina_List *l;
+   Termpty *ty;
+   uint64_t bytes = 0;
    int i;
-//   int c0 = 0, c1 = 0;
 
-   if (!ty->back) return;
-   for (i = 0; i < ty->backmax; i++)
+   EINA_LIST_FOREACH(ptys, l, ty)
+     {
+        for (i = 0; i < ty->rewrap.num; i++)
+          {
+             Termsave *ts = ty->rewrap.rows[i];
+
+             // shared rows stay for as long as history uses them
+             if ((!ts) || (ts == &_blank_row) || (ts->shared)) continue;
+             bytes += _ts_size(ts);
+          }
+     }
+   return bytes;
+}
+
+static void
+_enforce_budget(void)
+{
+   Eina_List *l;
+   Termpty *ty;
+   uint64_t *held;
+   int i, num, victim;
+
+   num = eina_list_count(ptys);
+   if (num <= 0) return;
+   held = calloc(num, sizeof(uint64_t));
+   if (!held) return;
+   i = 0;
+   EINA_LIST_FOREACH(ptys, l, ty) held[i++] = _held_bytes(ty);
+   // rows are all compressed by now, so the only thing left to do is to
+   // drop the oldest history - always take it from the terminal holding
+   // the most memory so one busy tab does not wipe out all the others
+   while (_over_budget())
+     {
+        uint64_t bytes;
+
+        victim = -1;
+        for (i = 0; i < num; i++)
+          {
+             if (held[i] == 0) continue;
+             if ((victim < 0) || (held[i] > held[victim])) victim = i;
+          }
+        if (victim < 0) break;
+        bytes = _evict_pty(eina_list_nth(ptys, victim), 64);
+        // whatever is left there is not worth anything to drop
+        if ((bytes == 0) || (bytes >= held[victim])) held[victim] = 0;
+        else held[victim] -= bytes;
+     }
+   free(held);
+}
+
+static int
+_compact_pick(Alloc **evac)
+{
+   int i, j, num = 0;
+
+   // only older generations - the current ones are still filling up
+   for (i = 0; i < MEM_BLOCKS; i++)
      {
-        Termsavecomp *tsc = (Termsavecomp *)ty->back[i];
+        Alloc *al = alloc[i];
 
-        if (tsc)
+        if ((!al) || (al->gen == cur_gen)) continue;
+        if ((al->allocated * 4) >= al->size) continue;
+        if (num < COMPACT_BLOCKS)
+          evac[num++] = al;
+        else
           {
-             ty->back[i] = _save_comp(ty->back[i]);
-             tsc = (Termsavecomp *)ty->back[i];
-             if (tsc->comp) ts_comp++;
-             else ts_uncomp++;
-//             c0 += tsc->w;
-//             c1 += tsc->wout * sizeof(Termcell);
+             int full = 0;
+
+             // keep the emptiest ones - al takes the place of the fullest
+             for (j = 1; j < num; j++)
+               {
+                  if (evac[j]->allocated > evac[full]->allocated) full = j;
+               }
+             if (evac[full]->allocated > al->allocated) evac[full] = al;
           }
      }
-//   printf("compress ratio: %1.3f\n", (double)c0 / (double)c1);
+   // moving the rows of a single block just fills another one
+   if (num < 2) return 0;
+   for (i = 0; i < num; i++) evac[i]->evac = 1;
+   return num;
+}
+
+static Eina_Bool
+_compact_in(Alloc **evac, int num, const void *ptr)
+{
+   const unsigned char *p = ptr;
+   int i;
+
+   for (i = 0; i < num; i++)
+     {
+        const unsigned char *al = (const unsigned char *)evac[i];
+
+        if ((p >= al) && (p < (al + evac[i]->size))) return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+static Termsave *
+_compact_move(Termsave *ts, Eina_Hash *moved)
+{
+   Termsavecomp *tsc = (Termsavecomp *)ts;
+   Termsave *ts2;
+   unsigned int sz = _ts_size(ts);
+
+   ts2 = _ts_new(sz);
+   if (!ts2) return ts;
+   memcpy(ts2, ts, sz);
+   ts2->gen = _mem_gen_get();
+   if ((ts->comp) && (!ts->spill))
+     {
+        unsigned int slot = _dedup_slot(tsc);
+
+        if (dedup[slot] == tsc) dedup[slot] = (Termsavecomp *)ts2;
+     }
+   if (ts->shared)
+     {
+        void *refs = eina_hash_find(dedup_refs, &ts);
+
+        // other slots still point at the old copy - keep it around until
+        // all of them have been switched over
+        eina_hash_del_by_key(dedup_refs, &ts);
+        eina_hash_add(dedup_refs, &ts2, refs);
+        eina_hash_add(moved, &ts, ts2);
+        ts->shared = 0;
+        return ts2;
+     }
+   // ts2 took over the spilled data and the dedup slot, only the old
+   // copy's space goes
+   _ts_block_free(ts);
+   return ts2;
+}
+
+static Eina_Bool
+_compact_free_cb(const Eina_Hash *hash EINA_UNUSED, const void *key,
+                 void *data EINA_UNUSED, void *fdata EINA_UNUSED)
+{
+   _ts_block_free(*(void **)key);
+   return EINA_TRUE;
+}
+
+static void
+_compact_rows(Termsave **rows, int n, Alloc **evac, int num,
+              Eina_Hash *moved)
+{
+   int j;
+
+   for (j = 0; j < n; j++)
+     {
+        Termsave *ts = rows[j], *ts2;
+
+        if ((!ts) || (!_compact_in(evac, num, ts))) continue;
+        ts2 = eina_hash_find(moved, &ts);
+        if (!ts2) ts2 = _compact_move(ts, moved);
+        rows[j] = ts2;
+     }
+}
+
+static uint64_t
+_compact_step(void)
+{
+   Alloc *evac[COMPACT_BLOCKS];
+   Eina_Hash *moved;
+   Eina_List *l;
+   Termpty *ty;
+   uint64_t unmapped = _unmapped;
+   int i, num;
+
+   num = _compact_pick(evac);
+   if (num <= 0) return 0;
+   moved = eina_hash_pointer_new(NULL);
+   if (!moved)
+     {
+        for (i = 0; i < num; i++) evac[i]->evac = 0;
+        return 0;
+     }
+   // an extra count keeps emptied blocks mapped while _compact_in() still
+   // looks at them
+   for (i = 0; i < num; i++) evac[i]->count++;
+   ts_compfreeze++;
+   EINA_LIST_FOREACH(ptys, l, ty)
+     {
+        int c;
+
+        // rows rewrapped in idle time are not in history yet, but they
+        // can share rows with it all the same
+        if (ty->rewrap.rows)
+          _compact_rows(ty->rewrap.rows, ty->rewrap.num, evac, num, moved);
+        if (!ty->back.chunks) continue;
+        for (c = 0; c < ty->back.num; c++)
+          {
+             Termsave **chunk = ty->back.chunks[c];
+
+             if (!chunk) continue;
+             _compact_rows(chunk, TERMPTY_BACK_CHUNK, evac, num, moved);
+          }
+     }
+   eina_hash_foreach(moved, _compact_free_cb, NULL);
+   eina_hash_free(moved);
+   ts_compfreeze--;
+   for (i = 0; i < num; i++)
+     {
+        Alloc *al = evac[i];
+
+        if (--al->count > 0) continue;
+        alloc[al->slot] = NULL;
+        _unmapped += al->size;
+        munmap(al, al->size);
+     }
+   // blocks that could not be emptied are usable again
+   for (i = 0; i < MEM_BLOCKS; i++)
+     {
+        if (alloc[i]) alloc[i]->evac = 0;
+     }
+   _mem_defrag();
+   return _unmapped - unmapped;
+}
+
+static Eina_Bool
+_compact_idler(void *data EINA_UNUSED)
+{
+   uint64_t bytes = _compact_step();
+
+   if (bytes > 0)
+     {
+        _reclaimed += bytes;
+        return EINA_TRUE;
+     }
+   DBG("scrollback compaction done, %llu bytes reclaimed so far",
+       (unsigned long long)_reclaimed);
+   compact_idler = NULL;
+   return EINA_FALSE;
 }
 
 static Eina_Bool
@@ -287,25 +1069,35 @@ _idler(void *data EINA_UNUSED)
 {
    Eina_List *l;
    Termpty *ty;
-//   double t0, t;
+   Termsave_Policy p;
+   double t0;
 
    _mem_gen_next();
+   _policy_current(&p);
 
-//   t0 = ecore_time_get();
+   t0 = ecore_time_get();
    // start afresh and count comp/uncomp;
    ts_comp = 0;
    ts_uncomp = 0;
    EINA_LIST_FOREACH(ptys, l, ty)
      {
-        _walk_pty(ty);
+        _walk_pty(ty, &p);
+        _spill_pty(ty);
      }
-//   t = ecore_time_get();
-//   printf("comp/uncomp %i/%i time spent %1.5f\n", ts_comp, ts_uncomp, t - t0);
+   // a pending rewrap counts once it is swapped in, till then evicting
+   // history for it would only empty the other terminals
+   _pending = _pending_bytes();
+   if (_over_budget()) _enforce_budget();
    _mem_defrag();
    ts_freeops = 0;
+   // whatever is still raw now is hot and meant to stay so
+   ts_uncomp_hot = ts_uncomp;
+   ts_comptime += ecore_time_get() - t0;
+   ts_compruns++;
 
    _mem_gen_next();
 
+   if (!compact_idler) compact_idler = ecore_idler_add(_compact_idler, NULL);
    idler = NULL;
    return EINA_FALSE;
 }
@@ -321,9 +1113,13 @@ _timer(void *data EINA_UNUSED)
 static inline void
 _check_compressor(Eina_Bool frozen)
 {
+   Termsave_Policy p;
+
    if (freeze) return;
    if (idler) return;
-   if ((ts_uncomp > 256) || (ts_freeops > 256))
+   _policy_current(&p);
+   if (((ts_uncomp - ts_uncomp_hot) > p.trigger) ||
+       (ts_freeops > p.trigger) || (_over_budget()))
      {
         if (timer && !frozen) ecore_timer_reset(timer);
         else if (!timer) timer = ecore_timer_add(0.2, _timer, NULL);
@@ -344,6 +1140,12 @@ termpty_save_freeze(void)
         ecore_idler_del(idler);
         idler = NULL;
      }
+   // rows must not move under anyone holding on to them while frozen
+   if (compact_idler)
+     {
+        ecore_idler_del(compact_idler);
+        compact_idler = NULL;
+     }
 }
 
 void
@@ -358,11 +1160,31 @@ termpty_save_thaw(void)
      }
 }
 
+static Eina_Bool
+_screen_timer(void *data EINA_UNUSED)
+{
+   Eina_List *l;
+   Termpty *ty;
+   double t;
+
+   // someone may be holding on to screen cells
+   if (freeze) return EINA_TRUE;
+   t = ecore_loop_time_get();
+   EINA_LIST_FOREACH(ptys, l, ty)
+     {
+        if ((t - ty->packed.last) >= SCREEN_PACK_IDLE)
+          termpty_screen_pack(ty);
+     }
+   return EINA_TRUE;
+}
+
 void
 termpty_save_register(Termpty *ty)
 {
    termpty_save_freeze();
    ptys = eina_list_append(ptys, ty);
+   if (!screen_timer)
+     screen_timer = ecore_timer_add(SCREEN_PACK_IDLE / 4.0, _screen_timer, NULL);
    termpty_save_thaw();
 }
 
@@ -371,9 +1193,122 @@ termpty_save_unregister(Termpty *ty)
 {
    termpty_save_freeze();
    ptys = eina_list_remove(ptys, ty);
+   if ((!ptys) && (screen_timer))
+     {
+        ecore_timer_del(screen_timer);
+        screen_timer = NULL;
+     }
    termpty_save_thaw();
 }
 
+void *
+termpty_save_screen_pack(const Termcell *cells, int n, int *bytes)
+{
+   unsigned char *planes;
+   char *buf, *buf2;
+   int size = n * sizeof(Termcell);
+
+   planes = malloc(size);
+   buf = malloc(LZ4_compressBound(size));
+   if ((!planes) || (!buf))
+     {
+        free(planes);
+        free(buf);
+        return NULL;
+     }
+   // same layout as cold rows - lots of runs in each plane for a screen
+   _cells_planes_split((const unsigned char *)cells, planes, n);
+   *bytes = LZ4_compress((char *)planes, buf, size);
+   free(planes);
+   buf2 = realloc(buf, *bytes);
+   if (buf2) buf = buf2;
+   return buf;
+}
+
+Eina_Bool
+termpty_save_screen_unpack(const void *buf, int bytes,
+                           Termcell *cells, int n)
+{
+   unsigned char *planes;
+   int size = n * sizeof(Termcell);
+
+   planes = malloc(size);
+   if (!planes) return EINA_FALSE;
+   if (LZ4_uncompress(buf, (char *)planes, size) != bytes)
+     {
+        free(planes);
+        return EINA_FALSE;
+     }
+   _cells_planes_join(planes, (unsigned char *)cells, n);
+   free(planes);
+   return EINA_TRUE;
+}
+
+static void
+_unpack(const Termsavecomp *tsc, Termcell *cells)
+{
+   char *buf, *dst;
+   int bytes;
+
+   dst = (char *)cells;
+   if (tsc->cold) dst = alloca(tsc->wout * sizeof(Termcell));
+   if (tsc->spill)
+     bytes = _spill_load((Termsavespill *)tsc, dst,
+                         tsc->wout * sizeof(Termcell));
+   else
+     {
+        buf = ((char *)tsc) + sizeof(Termsavecomp);
+        bytes = LZ4_uncompress(buf, dst, tsc->wout * sizeof(Termcell));
+     }
+   if ((tsc->cold) && (bytes >= 0))
+     _cells_planes_join((unsigned char *)dst, (unsigned char *)cells,
+                        tsc->wout);
+   if (bytes < 0)
+     {
+        memset(cells, 0, tsc->wout * sizeof(Termcell));
+//        ERR("Decompress problem in row at byte %i", -bytes);
+     }
+}
+
+int
+termpty_save_width_get(const Termsave *ts)
+{
+   if (!ts) return 0;
+   if (ts->z) return ((const Termsavecomp *)ts)->wout;
+   return ts->w;
+}
+
+int
+termpty_save_peek(const Termsave *ts, Termcell *cells)
+{
+   if (!ts) return 0;
+   if (ts->z)
+     {
+        _unpack((const Termsavecomp *)ts, cells);
+        return ((const Termsavecomp *)ts)->wout;
+     }
+   if (ts->pal)
+     _pal_unpack((const Termsavepal *)ts, cells);
+   else
+     memcpy(cells, ts->cell, ts->w * sizeof(Termcell));
+   return ts->w;
+}
+
+Termsave *
+termpty_save_pack(Termsave *ts)
+{
+   Termsave *ts2;
+
+   if ((!ts) || (ts->z) || (ts == &_blank_row)) return ts;
+   ts2 = _save_comp(ts);
+   if ((ts2 != ts) && (!ts_compfreeze))
+     {
+        ts_uncomp--;
+        ts_comp++;
+     }
+   return ts2;
+}
+
 Termsave *
 termpty_save_extract(Termsave *ts)
 {
@@ -382,21 +1317,12 @@ termpty_save_extract(Termsave *ts)
      {
         Termsavecomp *tsc = (Termsavecomp *)ts;
         Termsave *ts2;
-        char *buf;
-        int bytes;
 
         ts2 = _ts_new(sizeof(Termsave) + ((tsc->wout - 1) * sizeof(Termcell)));
         if (!ts2) return NULL;
         ts2->gen = _mem_gen_get();
         ts2->w = tsc->wout;
-        buf = ((char *)tsc) + sizeof(Termsavecomp);
-        bytes = LZ4_uncompress(buf, (char *)(&(ts2->cell[0])),
-                               tsc->wout * sizeof(Termcell));
-        if (bytes < 0)
-          {
-             memset(&(ts2->cell[0]), 0, tsc->wout * sizeof(Termcell));
-//             ERR("Decompress problem in row at byte %i", -bytes);
-          }
+        _unpack(tsc, &(ts2->cell[0]));
         if (ts->comp) ts_comp--;
         else ts_uncomp--;
         ts_uncomp++;
@@ -407,6 +1333,22 @@ termpty_save_extract(Termsave *ts)
         _check_compressor(EINA_FALSE);
         return ts2;
      }
+   if (ts->pal)
+     {
+        Termsave *ts2;
+
+        ts2 = _ts_new(sizeof(Termsave) + ((ts->w - 1) * sizeof(Termcell)));
+        if (!ts2) return NULL;
+        ts2->gen = _mem_gen_get();
+        ts2->w = ts->w;
+        _pal_unpack((Termsavepal *)ts, &(ts2->cell[0]));
+        ts_freeops++;
+        ts_compfreeze++;
+        _ts_free(ts);
+        ts_compfreeze--;
+        _check_compressor(EINA_FALSE);
+        return ts2;
+     }
    _check_compressor(EINA_FALSE);
    return ts;
 }
@@ -414,7 +1356,10 @@ termpty_save_extract(Termsave *ts)
 Termsave *
 termpty_save_new(int w)
 {
-   Termsave *ts = _ts_new(sizeof(Termsave) + ((w - 1) * sizeof(Termcell)));
+   Termsave *ts;
+
+   if (w <= 0) return &_blank_row;
+   ts = _ts_new(sizeof(Termsave) + ((w - 1) * sizeof(Termcell)));
    if (!ts) return NULL;
    ts->gen = _mem_gen_get();
    ts->w = w;
@@ -423,10 +1368,80 @@ termpty_save_new(int w)
    return ts;
 }
 
+/* palette of the attributes in cells and the index of each cell in it,
+ * -1 if there are more than PAL_MAX */
+static int
+_pal_build(const Termcell *cells, int w, uint64_t *pal, unsigned char *idx)
+{
+   uint64_t a;
+   int npal = 0, last = 0, i, j;
+
+   for (i = 0; i < w; i++)
+     {
+        memcpy(&a, ((const unsigned char *)&(cells[i])) + PAL_ATT_OFF,
+               PAL_ATT_SIZE);
+        // attributes come in runs so the last one used is the best bet
+        if ((npal > 0) && (pal[last] == a))
+          {
+             idx[i] = last;
+             continue;
+          }
+        for (j = 0; j < npal; j++)
+          {
+             if (pal[j] == a) break;
+          }
+        if (j == npal)
+          {
+             if (npal == PAL_MAX) return -1;
+             pal[npal++] = a;
+          }
+        idx[i] = last = j;
+     }
+   return npal;
+}
+
+Termsave *
+termpty_save_intern(const Termcell *cells, int w)
+{
+   uint64_t pal[PAL_MAX];
+   unsigned char *idx, *p;
+   Eina_Unicode *cp;
+   Termsavepal *tsp;
+   Termsave *ts;
+   int npal, i;
+
+   if (w <= 0) return termpty_save_new(0);
+   idx = alloca(w);
+   npal = _pal_build(cells, w, pal, idx);
+   if (npal < 0) goto raw;
+   // very short rows are no smaller this way
+   if (_pal_size(npal, w) >= sizeof(Termsave) + ((w - 1) * sizeof(Termcell)))
+     goto raw;
+   tsp = _ts_new(_pal_size(npal, w));
+   if (!tsp) return NULL;
+   tsp->gen = _mem_gen_get();
+   tsp->pal = 1;
+   tsp->w = w;
+   tsp->npal = npal;
+   p = (unsigned char *)(tsp + 1);
+   memcpy(p, pal, npal * PAL_ATT_SIZE);
+   cp = (Eina_Unicode *)(p + (npal * PAL_ATT_SIZE));
+   for (i = 0; i < w; i++) cp[i] = cells[i].codepoint;
+   memcpy(cp + w, idx, w);
+   if (!ts_compfreeze) ts_uncomp++;
+   _check_compressor(EINA_FALSE);
+   return (Termsave *)tsp;
+raw:
+   ts = termpty_save_new(w);
+   if (!ts) return NULL;
+   memcpy(&(ts->cell[0]), cells, w * sizeof(Termcell));
+   return ts;
+}
+
 void
 termpty_save_free(Termsave *ts)
 {
-   if (!ts) return;
+   if ((!ts) || (ts == &_blank_row)) return;
    if (!ts_compfreeze)
      {
         if (ts->comp) ts_comp--;
@@ -436,3 +1451,302 @@ termpty_save_free(Termsave *ts)
    _ts_free(ts);
    _check_compressor(EINA_FALSE);
 }
+
+void
+termpty_save_budget_set(uint64_t bytes)
+{
+   if (_budget == bytes) return;
+   _budget = bytes;
+   _check_compressor(EINA_FALSE);
+}
+
+uint64_t
+termpty_save_budget_get(void)
+{
+   return _budget;
+}
+
+uint64_t
+termpty_save_allocated_get(void)
+{
+   return _allocated;
+}
+
+static Eina_Bool
+_spill_open(Termpty *ty)
+{
+   Termspill *sp;
+   const char *tmp;
+   char buf[PATH_MAX];
+   int i, fd;
+
+   for (i = 0; i < SPILL_MAX; i++)
+     {
+        if (!spills[i]) break;
+     }
+   if (i >= SPILL_MAX)
+     {
+        ERR("Out of spill file slots");
+        return EINA_FALSE;
+     }
+   tmp = getenv("TMPDIR");
+   if (!tmp) tmp = "/tmp";
+   snprintf(buf, sizeof(buf), "%s/terminology-spill-XXXXXX", tmp);
+   fd = mkstemp(buf);
+   if (fd < 0)
+     {
+        ERR("Cannot create spill file %s: %s", buf, strerror(errno));
+        return EINA_FALSE;
+     }
+   // the name is not needed, only the fd. unlinking now means the file
+   // goes away with the fd on termpty_free - or with the process if it
+   // ever crashes
+   unlink(buf);
+   if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+     ERR("Cannot set close-on-exec on spill file: %s", strerror(errno));
+   sp = calloc(1, sizeof(Termspill));
+   if (!sp)
+     {
+        close(fd);
+        return EINA_FALSE;
+     }
+   sp->fd = fd;
+   sp->slot = i;
+   spills[i] = sp;
+   ty->spill = sp;
+   return EINA_TRUE;
+}
+
+static void
+_spill_close(Termpty *ty)
+{
+   Termspill *sp = ty->spill;
+   int i;
+
+   // pull anything still out on disk back into memory first
+   if (ty->back.chunks)
+     {
+        for (i = 0; i < ty->backmax; i++)
+          {
+             Termsave *ts, *ts2;
+
+             ts = termpty_back_get(&ty->back, i);
+             if ((!ts) || (!ts->spill)) continue;
+             ts2 = termpty_save_extract(ts);
+             if (!ts2)
+               {
+                  termpty_save_free(ts);
+                  ERR("Dropping spilled row, cannot allocate it");
+               }
+             termpty_back_set(&ty->back, ty->backmax, i, ts2);
+          }
+     }
+   // the rows that were out are raw now
+   ty->backcold = ty->backspilled = 0;
+   spills[sp->slot] = NULL;
+   close(sp->fd);
+   free(sp);
+   ty->spill = NULL;
+}
+
+Eina_Bool
+termpty_save_spill_set(Termpty *ty, Eina_Bool enabled)
+{
+   Eina_Bool ret = EINA_TRUE;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, EINA_FALSE);
+   if ((!!ty->spill) == (!!enabled)) return EINA_TRUE;
+   termpty_save_freeze();
+   if (enabled) ret = _spill_open(ty);
+   else _spill_close(ty);
+   termpty_save_thaw();
+   return ret;
+}
+
+Eina_Bool
+termpty_save_spill_get(const Termpty *ty)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ty, EINA_FALSE);
+   return !!ty->spill;
+}
+
+void
+termpty_save_policy_set(const Termsave_Policy *p)
+{
+   EINA_SAFETY_ON_NULL_RETURN(p);
+   policy = *p;
+   if (policy.hot_rows < 0) policy.hot_rows = 0;
+   if (policy.warm_rows < 0) policy.warm_rows = 0;
+   if (policy.trigger < 1) policy.trigger = 1;
+   _check_compressor(EINA_FALSE);
+}
+
+void
+termpty_save_policy_get(Termsave_Policy *p)
+{
+   EINA_SAFETY_ON_NULL_RETURN(p);
+   *p = policy;
+}
+
+uint64_t
+termpty_save_compact(void)
+{
+   uint64_t bytes, total = 0;
+
+   if (freeze) return 0;
+   while ((bytes = _compact_step()) > 0) total += bytes;
+   _reclaimed += total;
+   return total;
+}
+
+uint64_t
+termpty_save_reclaimed_get(void)
+{
+   return _reclaimed;
+}
+
+static void
+_stats_pty(const Termpty *ty, Termsave_Stats *st)
+{
+   int c, j;
+
+   if (!ty->back.chunks) return;
+   for (c = 0; c < ty->back.num; c++)
+     {
+        Termsave **chunk = ty->back.chunks[c];
+
+        if (!chunk) continue;
+        for (j = 0; j < TERMPTY_BACK_CHUNK; j++)
+          {
+             Termsave *ts = chunk[j];
+             Termsavecomp *tsc = (Termsavecomp *)ts;
+
+             if (!ts) continue;
+             if (ts == &_blank_row)
+               {
+                  st->rows_blank++;
+                  continue;
+               }
+             if (ts->shared) st->rows_shared++;
+             st->bytes_resident += _ts_size(ts);
+             if (ts->spill)
+               {
+                  st->rows_spilled++;
+                  st->bytes_spilled += tsc->w;
+               }
+             else if (ts->cold) st->rows_cold++;
+             else if (ts->comp) st->rows_comp++;
+             else st->rows_raw++;
+             if (ts->comp)
+               {
+                  st->bytes_cells += tsc->wout * sizeof(Termcell);
+                  st->bytes_comp += tsc->w;
+               }
+             else
+               st->bytes_cells += ts->w * sizeof(Termcell);
+          }
+     }
+}
+
+void
+termpty_save_stats_get(const Termpty *ty, Termsave_Stats *st)
+{
+   Eina_List *l;
+   Termpty *ty2;
+   int i;
+
+   EINA_SAFETY_ON_NULL_RETURN(st);
+   memset(st, 0, sizeof(Termsave_Stats));
+   if (ty) _stats_pty(ty, st);
+   else
+     {
+        EINA_LIST_FOREACH(ptys, l, ty2) _stats_pty(ty2, st);
+     }
+   for (i = 0; i < MEM_BLOCKS; i++)
+     {
+        if (!alloc[i]) continue;
+        st->blocks++;
+        st->bytes_mapped += alloc[i]->size;
+     }
+   st->bytes_allocated = _allocated;
+   st->bytes_budget = _budget;
+   st->bytes_reclaimed = _reclaimed;
+   st->comp_time = ts_comptime;
+   st->comp_runs = ts_compruns;
+}
+
+static Eina_Bool
+_view_scratch(Termrow *row, int w)
+{
+   int size;
+   void *buf;
+
+   size = ((PAL_MAX + w) * sizeof(Termcell)) +
+     (w * (sizeof(Eina_Unicode) + 1));
+   if (size <= row->size) return EINA_TRUE;
+   buf = realloc(row->buf, size);
+   if (!buf) return EINA_FALSE;
+   row->buf = buf;
+   row->size = size;
+   return EINA_TRUE;
+}
+
+/* scratch is PAL_MAX palette cells, w cells, w codepoints, w indexes */
+static Eina_Bool
+_view_build(const Termcell *cells, int w, Termrow *row)
+{
+   uint64_t pal[PAL_MAX];
+   Termcell *palcells = row->buf;
+   Eina_Unicode *cp = (Eina_Unicode *)(palcells + PAL_MAX + w);
+   unsigned char *idx = (unsigned char *)(cp + w);
+   int i;
+
+   row->npal = _pal_build(cells, w, pal, idx);
+   if (row->npal < 0) return EINA_FALSE;
+   for (i = 0; i < row->npal; i++)
+     memcpy(((unsigned char *)&(palcells[i])) + PAL_ATT_OFF, &(pal[i]),
+            PAL_ATT_SIZE);
+   for (i = 0; i < w; i++) cp[i] = cells[i].codepoint;
+   row->codepoints = cp;
+   row->idx = idx;
+   row->pal = palcells;
+   row->w = w;
+   return EINA_TRUE;
+}
+
+Eina_Bool
+termpty_save_view_cells(const Termcell *cells, int w, Termrow *row)
+{
+   if (!_view_scratch(row, w)) return EINA_FALSE;
+   return _view_build(cells, w, row);
+}
+
+Eina_Bool
+termpty_save_view(const Termsave *ts, Termrow *row)
+{
+   Termcell *cells;
+   int w = termpty_save_width_get(ts);
+
+   if (!_view_scratch(row, w)) return EINA_FALSE;
+   if ((ts) && (ts->pal))
+     {
+        // already in planes, only the palette needs spreading out
+        const Termsavepal *tsp = (const Termsavepal *)ts;
+        const unsigned char *pal = (const unsigned char *)(tsp + 1);
+        Termcell *palcells = row->buf;
+        unsigned int i;
+
+        for (i = 0; i < tsp->npal; i++)
+          memcpy(((unsigned char *)&(palcells[i])) + PAL_ATT_OFF,
+                 pal + (i * PAL_ATT_SIZE), PAL_ATT_SIZE);
+        row->codepoints = (const Eina_Unicode *)(pal + (tsp->npal * PAL_ATT_SIZE));
+        row->idx = (const unsigned char *)(row->codepoints + tsp->w);
+        row->pal = palcells;
+        row->npal = tsp->npal;
+        row->w = tsp->w;
+        return EINA_TRUE;
+     }
+   cells = ((Termcell *)row->buf) + PAL_MAX;
+   termpty_save_peek(ts, cells);
+   return _view_build(cells, w, row);
+}
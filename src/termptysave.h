@@ -1,12 +1,84 @@
 #ifndef _TERMPTY_SAVE_H__
 #define _TERMPTY_SAVE_H__ 1
 
+/* longest history allowed in memory only, and with a spill file */
+#define TERMPTY_SAVE_BACK_MAX       131072
+#define TERMPTY_SAVE_BACK_SPILL_MAX 2097152
+
+typedef struct _Termsave_Policy Termsave_Policy;
+
+/* rows are kept raw while hot, in fast lz4 while warm and in the
+ * higher ratio cold format after that. all of these shrink when the
+ * memory budget gets tight */
+struct _Termsave_Policy
+{
+   int hot_rows; /* newest rows of each pty left uncompressed */
+   int warm_rows; /* rows after the hot ones that stay in fast lz4 */
+   int trigger; /* new raw rows or frees before the compressor runs */
+};
+
 void termpty_save_freeze(void);
 void termpty_save_thaw(void);
 void termpty_save_register(Termpty *ty);
 void termpty_save_unregister(Termpty *ty);
 Termsave *termpty_save_extract(Termsave *ts);
 Termsave *termpty_save_new(int w);
+/* a row holding a copy of cells, with attributes interned when smaller */
+Termsave *termpty_save_intern(const Termcell *cells, int w);
+/* decompressed width of a row and a copy of its cells, leaving it as is */
+int termpty_save_width_get(const Termsave *ts);
+int termpty_save_peek(const Termsave *ts, Termcell *cells);
+/* compress a row that is not in any history yet */
+Termsave *termpty_save_pack(Termsave *ts);
 void termpty_save_free(Termsave *ts);
+/* process-wide limit in bytes on saved rows of all ptys, 0 = unlimited */
+void termpty_save_budget_set(uint64_t bytes);
+uint64_t termpty_save_budget_get(void);
+uint64_t termpty_save_allocated_get(void);
+/* move old compressed rows of ty out to an unlinked temp file */
+Eina_Bool termpty_save_spill_set(Termpty *ty, Eina_Bool enabled);
+Eina_Bool termpty_save_spill_get(const Termpty *ty);
+void termpty_save_policy_set(const Termsave_Policy *p);
+void termpty_save_policy_get(Termsave_Policy *p);
+/* move rows out of sparse blocks, returns bytes given back to the system */
+uint64_t termpty_save_compact(void);
+uint64_t termpty_save_reclaimed_get(void);
+
+typedef struct _Termsave_Stats Termsave_Stats;
+
+/* rows and bytes_* up to bytes_spilled cover one pty, or all of them
+ * when asked for NULL. shared rows count once per slot using them */
+struct _Termsave_Stats
+{
+   int rows_raw;
+   int rows_comp; /* fast lz4 */
+   int rows_cold;
+   int rows_spilled;
+   int rows_shared;
+   int rows_blank;
+   uint64_t bytes_resident; /* arena bytes used by the rows */
+   uint64_t bytes_cells; /* what the rows take once decompressed */
+   uint64_t bytes_comp; /* compressed payload, spilled rows included */
+   uint64_t bytes_spilled; /* of that, how much is on disk */
+   /* process wide */
+   uint64_t bytes_allocated;
+   uint64_t bytes_mapped;
+   uint64_t bytes_budget;
+   uint64_t bytes_reclaimed;
+   int blocks;
+   int comp_runs;
+   double comp_time; /* seconds */
+};
+
+void termpty_save_stats_get(const Termpty *ty, Termsave_Stats *st);
+
+/* fill a split view of a saved row, or of plain cells */
+Eina_Bool termpty_save_view(const Termsave *ts, Termrow *row);
+Eina_Bool termpty_save_view_cells(const Termcell *cells, int w, Termrow *row);
+
+/* whole screens, packed into a malloced buffer */
+void *termpty_save_screen_pack(const Termcell *cells, int n, int *bytes);
+Eina_Bool termpty_save_screen_unpack(const void *buf, int bytes,
+                                     Termcell *cells, int n);
 
 #endif
@@ -1145,6 +1145,29 @@ _cb_size_track(void *data, Evas *e EINA_UNUSED, Evas_Object *obj, void *event EI
    DBG("_cb_size_track (%dx%d)", w, h);
 }
 
+static void
+_cb_panes_press(void *data, Evas_Object *obj EINA_UNUSED, void *event EINA_UNUSED)
+{
+   Win *wn = data;
+   Eina_List *l;
+   Term *term;
+
+   // a drag of the split resizes terms on every move, hold off until done
+   EINA_LIST_FOREACH(wn->terms, l, term)
+     termio_size_defer_set(term->term, EINA_TRUE);
+}
+
+static void
+_cb_panes_unpress(void *data, Evas_Object *obj EINA_UNUSED, void *event EINA_UNUSED)
+{
+   Win *wn = data;
+   Eina_List *l;
+   Term *term;
+
+   EINA_LIST_FOREACH(wn->terms, l, term)
+     termio_size_defer_set(term->term, EINA_FALSE);
+}
+
 static void
 _term_resize_track_start(Split *sp)
 {
@@ -1181,6 +1204,8 @@ _split_split(Split *sp, Eina_Bool horizontal, char *cmd)
    evas_object_size_hint_align_set(o, EVAS_HINT_FILL, EVAS_HINT_FILL);
    sp->horizontal = horizontal;
    elm_panes_horizontal_set(o, sp->horizontal);
+   evas_object_smart_callback_add(o, "press", _cb_panes_press, sp->wn);
+   evas_object_smart_callback_add(o, "unpress", _cb_panes_unpress, sp->wn);
 
    _term_resize_track_stop(sp);
    sp1 = sp->s1 = calloc(1, sizeof(Split));
@@ -0,0 +1,177 @@
+/* spills history of a pty out to disk, frees most of it so the blocks
+ * holding what is left get compacted, and reads every row back.
+ *
+ * not part of the app, build and run it on its own:
+ *
+ *   cc -o termptysave_compact tests/termptysave_compact.c -Iinc -Isrc \
+ *      `pkg-config --cflags --libs elementary dlog` && ./termptysave_compact
+ *
+ * termptysave.c is included whole to get at its statics, the few history
+ * ring helpers of termpty.c it needs are below */
+
+#include "../src/termptysave.c"
+
+#define ROWS 40000
+#define W    80
+
+int _log_domain = -1;
+
+Eina_Bool
+termpty_back_set(Termback *back, int backmax, int i, Termsave *ts)
+{
+   Termsave **chunk;
+   int c = i / TERMPTY_BACK_CHUNK;
+
+   if (!back->chunks)
+     {
+        if (!ts) return EINA_TRUE;
+        back->num = (backmax + TERMPTY_BACK_CHUNK - 1) / TERMPTY_BACK_CHUNK;
+        back->chunks = calloc(back->num, sizeof(Termsave **));
+        if (!back->chunks) return EINA_FALSE;
+     }
+   chunk = back->chunks[c];
+   if (!chunk)
+     {
+        if (!ts) return EINA_TRUE;
+        chunk = calloc(TERMPTY_BACK_CHUNK, sizeof(Termsave *));
+        if (!chunk) return EINA_FALSE;
+        back->chunks[c] = chunk;
+     }
+   chunk[i % TERMPTY_BACK_CHUNK] = ts;
+   return EINA_TRUE;
+}
+
+void
+termpty_back_trim(Termback *back EINA_UNUSED, int i EINA_UNUSED)
+{
+}
+
+void
+termpty_rewrap_drop(Termpty *ty EINA_UNUSED, int n EINA_UNUSED)
+{
+}
+
+void
+termpty_screen_pack(Termpty *ty EINA_UNUSED)
+{
+}
+
+/* every row different so none of them get shared */
+static void
+_row_fill(Termcell *cells, int n)
+{
+   int i;
+
+   memset(cells, 0, W * sizeof(Termcell));
+   for (i = 0; i < W; i++)
+     cells[i].codepoint = 'a' + ((n * 7 + i * (1 + (n % 5))) % 26);
+   for (i = 0; i < 8; i++)
+     cells[i].codepoint = '0' + ((n >> (i * 3)) & 7);
+}
+
+static int
+_row_check(Termpty *ty, int n)
+{
+   Termcell cells[W], expect[W];
+   Termsave *ts;
+   int i, w;
+
+   ts = termpty_back_get(&ty->back, n);
+   if (!ts) return 1;
+   memset(cells, 0, sizeof(cells));
+   w = termpty_save_peek(ts, cells);
+   _row_fill(expect, n);
+   if (w != W)
+     {
+        fprintf(stderr, "row %i: width %i, expected %i\n", n, w, W);
+        return 0;
+     }
+   for (i = 0; i < W; i++)
+     {
+        if (cells[i].codepoint != expect[i].codepoint)
+          {
+             fprintf(stderr, "row %i: cell %i differs\n", n, i);
+             return 0;
+          }
+     }
+   return 1;
+}
+
+int
+main(void)
+{
+   Termpty *ty;
+   Termcell cells[W];
+   uint64_t bytes;
+   int i, spilled = 0, bad = 0;
+
+   eina_init();
+   ecore_init();
+   ty = calloc(1, sizeof(Termpty));
+   if (!ty) return 1;
+   ty->w = W;
+   ty->backmax = ROWS;
+   termpty_save_freeze();
+   termpty_save_register(ty);
+   if (!termpty_save_spill_set(ty, EINA_TRUE))
+     {
+        fprintf(stderr, "cannot open a spill file\n");
+        return 1;
+     }
+   for (i = 0; i < ROWS; i++)
+     {
+        _row_fill(cells, i);
+        termpty_back_set(&ty->back, ty->backmax, i,
+                         termpty_save_pack(termpty_save_intern(cells, W)));
+     }
+   ty->backpos = 0;
+   ty->backsaved = ROWS;
+   ty->backscroll_num = ROWS;
+   _mem_gen_next();
+   _spill_pty(ty);
+   _mem_gen_next();
+
+   // keep one row in 16 of those spilled, the blocks with their stubs
+   // are sparse enough to be compacted then
+   for (i = 0; i < ROWS; i++)
+     {
+        Termsave *ts = termpty_back_get(&ty->back, i);
+
+        if ((!ts) || (!ts->spill)) continue;
+        if ((spilled++ % 16) == 0) continue;
+        termpty_save_free(ts);
+        termpty_back_set(&ty->back, ty->backmax, i, NULL);
+     }
+   if (spilled < (ROWS - SPILL_KEEP_ROWS) / 2)
+     {
+        fprintf(stderr, "only %i of %i rows spilled\n", spilled, ROWS);
+        return 1;
+     }
+
+   // the compressor stays out of the way, compaction does not run frozen
+   termpty_save_thaw();
+   bytes = termpty_save_compact();
+   if (bytes == 0)
+     {
+        fprintf(stderr, "nothing compacted\n");
+        bad++;
+     }
+   for (i = 0; i < ROWS; i++)
+     {
+        if (!_row_check(ty, i)) bad++;
+     }
+   printf("%i rows spilled, %llu bytes compacted, %i bad rows\n",
+          spilled, (unsigned long long)bytes, bad);
+
+   for (i = 0; i < ROWS; i++)
+     termpty_save_free(termpty_back_get(&ty->back, i));
+   for (i = 0; i < ty->back.num; i++) free(ty->back.chunks[i]);
+   free(ty->back.chunks);
+   ty->back.chunks = NULL;
+   termpty_save_spill_set(ty, EINA_FALSE);
+   termpty_save_unregister(ty);
+   free(ty);
+   ecore_shutdown();
+   eina_shutdown();
+   return bad ? 1 : 0;
+}